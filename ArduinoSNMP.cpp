@@ -21,14 +21,60 @@
 #include "ArduinoSNMP.h"
 #include <EthernetUdp.h>
 
+#ifdef SNMP_NO_HEAP
+#pragma GCC poison malloc calloc realloc free
+#endif
+
+#ifdef SNMP_RAM_BUDGET
+static_assert(sizeof(SNMPClass) <= SNMP_RAM_BUDGET, "ArduinoSNMP: SNMPClass is larger than SNMP_RAM_BUDGET, reduce the sizing defines");
+#endif
+
 EthernetUDP Udp;
+SNMP_UPTIME SNMPUptime;
+
+// inform journal, see SNMP_JOURNAL
+#define SNMP_JOURNAL_RING_START     (2 * SNMP_JOURNAL_SUPERBLOCK_LEN)
+#define SNMP_JOURNAL_ENQUEUE        1
+#define SNMP_JOURNAL_ACK            2
+#define SNMP_JOURNAL_LIVE_MAX       ((uint32_t)SNMP_MAX_PENDING_INFORMS * (SNMP_JOURNAL_OVERHEAD + SNMP_MAX_PACKET_LEN))
+
+static void put_uint32(byte *buffer, uint32_t value){
+  for(byte i = 0; i < 4; i++){
+    buffer[i] = value >> (24 - 8*i);
+  }
+}
+
+static uint32_t get_uint32(const byte *buffer){
+  return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | buffer[3];
+}
 
 SNMP_API_STAT_CODES SNMPClass::begin(const char *getCommName, const char *setCommName, const char *trapCommName, uint16_t port)
 {
   //initialize request counter
     requestCounter = 1;
+    _lazyDecode = false;
     _extra_data_size = 0;
     _udp_extra_data_packet = false;
+    _producer = NULL;
+    _segmentCount = 0;
+    _txSize = 0;
+    _scratch.used = 0;
+    _scratch.high_water = 0;
+    _scratch.failed = 0;
+    _informCount = 0;
+    _informTimeout = 5000;
+    _nextInformCheck = 0;
+    _journal.read = NULL;
+    _journal.write = NULL;
+    for(byte i = 0; i < SNMP_MAX_TARGETS; i++){
+      _targets[i].address = IPAddress(0, 0, 0, 0);
+      _targets[i].dropped = 0;
+      _targets[i].min_severity = 0;
+    }
+    _filterCount = 0;
+    _filterUsed = 0;
+    _filtered = 0;
+    _agentAddress = IPAddress(0, 0, 0, 0);
     
   // set community name set/get sizes
   _setSize = strlen(setCommName);
@@ -61,6 +107,9 @@ boolean SNMPClass::listen(void)
   // and pointer to a function (delegate function)
   // isn't null, trigger the function
   
+  //keeps the sysUpTime clock across millis() rollover when no notifications are sent
+  SNMPUptime.read();
+  
   if(Udp.parsePacket() > 1024){
     _udp_extra_data_packet = true;
   }else{
@@ -86,29 +135,34 @@ boolean SNMPClass::listen(void)
    */
 SNMP_API_STAT_CODES SNMPClass::requestPdu(SNMP_PDU *pdu, char *extra_data, int extra_data_max_size)
 {
+  // offsets are 16-bit, packets can be longer than 255 bytes
   // sequence length
   uint16_t seqLen, valLen, vblLen, pduLen;
   // version
-  byte verLen, verEnd;
+  byte verLen;
+  uint16_t verEnd;
   // community string
-  byte comLen, comEnd;
+  byte comLen;
+  uint16_t comEnd;
   // pdu
-  byte pduTyp, pduEnd;
-  byte ridLen, ridEnd;
-  byte errLen, errEnd;
-  byte eriLen, eriEnd;
+  byte pduTyp;
+  uint16_t pduEnd;
+  byte ridLen, errLen, eriLen;
+  uint16_t ridEnd, errEnd, eriEnd;
   byte vblTyp;
   byte vbiTyp, vbiLen;
-  byte obiLen, obiEnd;
-  byte valTyp, valEnd;
+  byte obiLen;
+  uint16_t obiEnd;
+  byte valTyp;
+  uint16_t valEnd;
   int i;
 
+  //scratch memory from the previous request is released here at the latest
+  _scratch.reset();
+
   // set packet packet size (skip UDP header)
   _packetSize = Udp.available();
   _packetPos = 0;
-
-  // reset packet array
-  memset(_packet, 0, SNMP_MAX_PACKET_LEN);
   //
   // validate packet
   if ( _packetSize <= 0) {
@@ -122,122 +176,136 @@ SNMP_API_STAT_CODES SNMPClass::requestPdu(SNMP_PDU *pdu, char *extra_data, int e
       memset(extra_data, 0, extra_data_max_size);
     }
     
-    Udp.read(_packet, _packetSize - extra_data_max_size);
+    // the SNMP portion still has to fit in _rxPacket
+    if(_packetSize <= extra_data_max_size || _packetSize - extra_data_max_size > SNMP_MAX_PACKET_LEN){
+      return SNMP_API_STAT_PACKET_TOO_BIG;
+    }
+    _packetSize -= extra_data_max_size;
+    Udp.read(_rxPacket, _packetSize);
 
     if(extra_data != NULL){
       Udp.read((byte*)extra_data, extra_data_max_size);
     }
   }else{
-    Udp.read(_packet, _packetSize);
+    // datagram is read straight into _rxPacket, anything larger would run past the end of it.
+    // The unread remainder is discarded by the next parsePacket()
+    if(_packetSize > SNMP_MAX_PACKET_LEN){
+      pdu->error = SNMP_ERR_TOO_BIG;
+      return SNMP_API_STAT_PACKET_TOO_BIG;
+    }
+    Udp.read(_rxPacket, _packetSize);
   }
+
+  // only the bytes past the datagram need clearing, the parser below reads fixed offsets
+  memset(_rxPacket + _packetSize, 0, SNMP_MAX_PACKET_LEN - _packetSize);
   
 //  Serial.println("Incomming: ");
 //  for(int i = 0; i < _packetSize; i++){
-//    Serial.print(_packet[i],HEX);
+//    Serial.print(_rxPacket[i],HEX);
 //    Serial.print(" ");
 //  }
 //  Serial.println();
 
   // packet check 1
-  if ( _packet[0] != 0x30 ) {
+  if ( _rxPacket[0] != 0x30 ) {
     return SNMP_API_STAT_PACKET_INVALID;
   }
   
 
   // sequence length
-  if(_packet[1] >= 0x82){
-    seqLen = combine_msb_lsb(_packet[2], _packet[3]);
+  if(_rxPacket[1] >= 0x82){
+    seqLen = combine_msb_lsb(_rxPacket[2], _rxPacket[3]);
     _packetPos = 4;
   }
-  else if(_packet[1] == 0x81){
-    seqLen = _packet[2];
+  else if(_rxPacket[1] == 0x81){
+    seqLen = _rxPacket[2];
     _packetPos = 3;
   }else{
-    seqLen = _packet[1];
+    seqLen = _rxPacket[1];
     _packetPos = 2;
   }
   
   // version
-  if(_packet[_packetPos] != 0x02){
+  if(_rxPacket[_packetPos] != 0x02){
     return SNMP_API_STAT_PACKET_INVALID;
   }
   
-  verLen = _packet[_packetPos+1];//used to be hard coded as index 3
+  verLen = _rxPacket[_packetPos+1];//used to be hard coded as index 3
   verEnd = _packetPos+1 + verLen;
   
   // community string
-  comLen = _packet[verEnd + 2];
+  comLen = _rxPacket[verEnd + 2];
   comEnd = verEnd + 2 + comLen;
   
   // pdu
-  pduTyp = _packet[comEnd + 1];
-  if(_packet[comEnd + 2] >= 0x82){
-    pduLen = combine_msb_lsb(_packet[comEnd +3], _packet[comEnd +4]);
+  pduTyp = _rxPacket[comEnd + 1];
+  if(_rxPacket[comEnd + 2] >= 0x82){
+    pduLen = combine_msb_lsb(_rxPacket[comEnd +3], _rxPacket[comEnd +4]);
     pduEnd = comEnd + 2 + pduLen + 2;
     _packetPos = comEnd + 2 + 2;
   }
-  else if(_packet[comEnd + 2] == 0x81){
-    pduLen = _packet[comEnd +3];
+  else if(_rxPacket[comEnd + 2] == 0x81){
+    pduLen = _rxPacket[comEnd +3];
     pduEnd = comEnd + 2 + pduLen + 1;
     _packetPos = comEnd + 2 + 1;
   }else{
-    pduLen = _packet[comEnd + 2];
+    pduLen = _rxPacket[comEnd + 2];
     pduEnd = comEnd + 2 + pduLen;
     _packetPos = comEnd + 2;
   }
   
   //request id
-  ridLen = _packet[_packetPos + 2];
+  ridLen = _rxPacket[_packetPos + 2];
   ridEnd = _packetPos + 2 + ridLen;
   
   //error
-  errLen = _packet[ridEnd + 2];
+  errLen = _rxPacket[ridEnd + 2];
   errEnd = ridEnd + 2 + errLen;
   
   //error index
-  eriLen = _packet[errEnd + 2];
+  eriLen = _rxPacket[errEnd + 2];
   eriEnd = errEnd + 2 + eriLen;
   
   //variable bindings
-  vblTyp = _packet[eriEnd + 1];
-  if(_packet[eriEnd + 2] >= 0x82){
-    vblLen = combine_msb_lsb(_packet[eriEnd +3], _packet[eriEnd +4]);
+  vblTyp = _rxPacket[eriEnd + 1];
+  if(_rxPacket[eriEnd + 2] >= 0x82){
+    vblLen = combine_msb_lsb(_rxPacket[eriEnd +3], _rxPacket[eriEnd +4]);
     _packetPos = eriEnd + 2 + 2;
   }
-  else if(_packet[eriEnd + 2] == 0x81){
-    vblLen = _packet[eriEnd +3];
+  else if(_rxPacket[eriEnd + 2] == 0x81){
+    vblLen = _rxPacket[eriEnd +3];
     _packetPos = eriEnd + 2 + 1;
   }else{
-    vblLen = _packet[eriEnd + 2];
+    vblLen = _rxPacket[eriEnd + 2];
     _packetPos = eriEnd + 2;
   }
   
   //variable bindings id
-  vbiTyp = _packet[_packetPos + 1];
-  if(_packet[_packetPos + 2] > 0x80){
-    vbiLen = combine_msb_lsb(_packet[_packetPos +3], _packet[_packetPos +4]);
+  vbiTyp = _rxPacket[_packetPos + 1];
+  if(_rxPacket[_packetPos + 2] > 0x80){
+    vbiLen = combine_msb_lsb(_rxPacket[_packetPos +3], _rxPacket[_packetPos +4]);
     _packetPos = _packetPos + 2 + 2;
   }else{
-    vbiLen = _packet[_packetPos + 2];
+    vbiLen = _rxPacket[_packetPos + 2];
     _packetPos = _packetPos + 2;
   }
   
   //object identifier
-  obiLen = _packet[_packetPos + 2];
+  obiLen = _rxPacket[_packetPos + 2];
   obiEnd = _packetPos + 2 + obiLen;
   
   //unknown
-  valTyp = _packet[obiEnd + 1];
+  valTyp = _rxPacket[obiEnd + 1];
 
-  if(_packet[obiEnd + 2] >= 0x82){
-    valLen = combine_msb_lsb(_packet[obiEnd +3], _packet[obiEnd +4]);
+  if(_rxPacket[obiEnd + 2] >= 0x82){
+    valLen = combine_msb_lsb(_rxPacket[obiEnd +3], _rxPacket[obiEnd +4]);
     valEnd = obiEnd + 2 + valLen + 2;
   }
-  else if(_packet[obiEnd + 2] == 0x81){
-    valLen = _packet[obiEnd + 3];
+  else if(_rxPacket[obiEnd + 2] == 0x81){
+    valLen = _rxPacket[obiEnd + 3];
     valEnd = obiEnd + 2 + valLen + 1;
   }else{
-    valLen = _packet[obiEnd + 2];
+    valLen = _rxPacket[obiEnd + 2];
     valEnd = obiEnd + 2 + valLen;
   }
   
@@ -251,7 +319,7 @@ SNMP_API_STAT_CODES SNMPClass::requestPdu(SNMP_PDU *pdu, char *extra_data, int e
 //  Serial.println(pduTyp,HEX);
 
   // extract version
-  pdu->version = _packet[verEnd];
+  pdu->version = _rxPacket[verEnd];
 //  Serial.println(pdu->version,HEX);
   // validate version
   if(pdu->version != 0x0 && pdu->version != 0x1){
@@ -272,17 +340,17 @@ SNMP_API_STAT_CODES SNMPClass::requestPdu(SNMP_PDU *pdu, char *extra_data, int e
 
   // validate community name
   if ( pdu->type == SNMP_PDU_SET && comLen == _setSize ) {
-  	if(memcmp(_setCommName,_packet+verEnd+3,_setSize) != 0){
+  	if(memcmp(_setCommName,_rxPacket+verEnd+3,_setSize) != 0){
   		pdu->error = SNMP_ERR_NO_SUCH_NAME;
   		return SNMP_API_STAT_NO_SUCH_NAME;
   	}
   } else if ( pdu->type == SNMP_PDU_GET) {
-  	if(memcmp(_getCommName,_packet+verEnd+3,comLen) != 0 && memcmp(_setCommName,_packet+verEnd+3,comLen) != 0){
+  	if(memcmp(_getCommName,_rxPacket+verEnd+3,comLen) != 0 && memcmp(_setCommName,_rxPacket+verEnd+3,comLen) != 0){
   		pdu->error = SNMP_ERR_NO_SUCH_NAME;
   		return SNMP_API_STAT_NO_SUCH_NAME;
   	}
   } else if (pdu->type == SNMP_PDU_RESPONSE){
-    if(memcmp(_trapCommName,_packet+verEnd+3,comLen) != 0){
+    if(memcmp(_trapCommName,_rxPacket+verEnd+3,comLen) != 0){
       pdu->error = SNMP_ERR_NO_SUCH_NAME;
       return SNMP_API_STAT_NO_SUCH_NAME;
     }
@@ -297,21 +365,21 @@ SNMP_API_STAT_CODES SNMPClass::requestPdu(SNMP_PDU *pdu, char *extra_data, int e
   // extract reqiest-id 0x00 0x00 0x00 0x01 (4-byte int aka int32)
   pdu->requestId = 0;
   for ( i = 0; i < ridLen; i++ ) {
-    pdu->requestId = (pdu->requestId << 8) | _packet[ridEnd-ridLen+1 + i];
+    pdu->requestId = (pdu->requestId << 8) | _rxPacket[ridEnd-ridLen+1 + i];
   }
 
   // extract error 
   pdu->error = SNMP_ERR_NO_ERROR;
   int32_t err = 0;
   for ( i = 0; i < errLen; i++ ) {
-    err = (err << 8) | _packet[errEnd-errLen+1 + i];
+    err = (err << 8) | _rxPacket[errEnd-errLen+1 + i];
   }
   pdu->error = (SNMP_ERR_CODES)err;
 
   // extract error-index 
   pdu->errorIndex = 0;
   for ( i = 0; i < eriLen; i++ ) {
-    pdu->errorIndex = (pdu->errorIndex << 8) | _packet[eriEnd-eriLen+1 + i];
+    pdu->errorIndex = (pdu->errorIndex << 8) | _rxPacket[eriEnd-eriLen+1 + i];
   }
 
   /**
@@ -322,9 +390,11 @@ SNMP_API_STAT_CODES SNMPClass::requestPdu(SNMP_PDU *pdu, char *extra_data, int e
     pdu->error = SNMP_ERR_TOO_BIG;
     return SNMP_API_STAT_OID_TOO_BIG;
   }
-  //decode OID
-  memset(pdu->value.OID.data, 0, SNMP_MAX_OID_LEN);
-  if(pdu->value.OID.decode(_packet + (obiEnd-obiLen+1), obiLen) != SNMP_API_STAT_SUCCESS){
+  //view of the encoded OID, decoded now unless lazy decoding is enabled
+  pdu->oid_view.data = _rxPacket + (obiEnd-obiLen+1);
+  pdu->oid_view.size = obiLen;
+  pdu->value.OID.clear();
+  if(_lazyDecode == false && pdu->load_oid() != SNMP_API_STAT_SUCCESS){
     return SNMP_API_STAT_MALLOC_ERR;
   }
 
@@ -339,83 +409,119 @@ SNMP_API_STAT_CODES SNMPClass::requestPdu(SNMP_PDU *pdu, char *extra_data, int e
     pdu->error = SNMP_ERR_TOO_BIG;
     return SNMP_API_STAT_VALUE_TOO_BIG;
   }
-  //set value size
-  pdu->value.size = valLen;
+  pdu->value_view.data = NULL;
+  pdu->value_view.size = 0;
   
   if(_udp_extra_data_packet == true){
+    //set value size
+    pdu->value.size = valLen;
 //    memset(extra_data, '\0', extra_data_max_size);
 //    for ( i = 0; i < valLen; i++ ) {
-//      extra_data[i] = _packet[obiEnd+3 + i];
+//      extra_data[i] = _rxPacket[obiEnd+3 + i];
 //    }    
   }else{
-    memset(pdu->value.data, 0, SNMP_MAX_VALUE_LEN);
-    for ( i = 0; i < valLen; i++ ) {
-      pdu->value.data[i] = _packet[obiEnd+3 + i];
-    }    
+    //value bytes start after the (possibly long-form) length
+    pdu->value_view.data = _rxPacket + (valEnd-valLen+1);
+    pdu->value_view.size = valLen;
+    pdu->value.size = 0;
+
+    if(_lazyDecode == false){
+      pdu->load_value();
+    }
   }
 
   return SNMP_API_STAT_SUCCESS;
 }
 
 /**
- * Sends a PDU as a v1 trap. (needs testing after v2 trap changes)
+ * Lazy decoding leaves the OID and value in the receive buffer, see SNMP_PDU::oid_view/value_view.
+ * Handlers compare oid_view against pre-encoded OIDs and call load_oid()/load_value() only when needed.
+ * Views are valid until the next requestPdu(), sending does not touch the receive buffer.
+ *
+ * Original Auther: Rex Park
+ */
+void SNMPClass::set_lazy_decode(boolean enabled){
+  _lazyDecode = enabled;
+}
+
+/**
+ * Scratch memory for the request being handled, e.g. a place to decode a string value into.
+ *   Released all at once when the response is sent or the next request is read, don't keep the pointer past that.
+ *   Returns NULL when SNMP_SCRATCH_LEN is used up.
+ *
+ * Original Auther: Rex Park
+ */
+void *SNMPClass::scratch(uint16_t size){
+  return _scratch.alloc(size);
+}
+
+//most scratch memory in use at once since begin(), compare with SNMP_SCRATCH_LEN
+uint16_t SNMPClass::scratch_high_water(){
+  return _scratch.high_water;
+}
+
+/**
+ * Sends a PDU as a v1 trap.
  *   OID: The full enterprise OID for the trap you want to send: everything in the trap's OID from the initial .1 
  *     up to the enterprise number, including any subtrees within the enterprise but not the specific trap number.
  *   value: will be an array of pre-encoded data
+ *   agent_address: address reported as the trap's agent-addr
  *
  * Original Author: Yazgoo
  * Updated: Rex Park, March 29, 2013. (Adjusting for new encoding changes and PDU structure)
- *
- * Broken as of November 10th 2013 due to writeHeaders re-write. Needs to be modified to work like responsePdu
+ * Updated: Rebuilt on SNMP_BER_WRITER, lengths are computed while encoding instead of patched afterwards.
+ * Updated: specific_trap is a full INTEGER. v2 notifications sent with notify() reach v1 targets translated, see sendTranslatedTrap.
  */
-uint32_t SNMPClass::sendTrapv1(SNMP_PDU *pdu, SNMP_TRAP_TYPES trap_type, int16_t specific_trap, IPAddress manager_address){
-
+uint32_t SNMPClass::sendTrapv1(SNMP_PDU *pdu, SNMP_TRAP_TYPES trap_type, int32_t specific_trap, IPAddress manager_address){
+  SNMP_BER_WRITER writer;
   byte i;
-  SNMP_VALUE value;
+
   _dstType = pdu->type = SNMP_PDU_TRAP;
-  _packetPos = 0;
-  uint16_t size = 27 + 2 + pdu->value.size;
-  
-  this->writeHeaders(pdu);
-  
-  //unknown
-  _packet[_packetPos++] = (byte) size - 1;
-  i = _packetPos-1;//i now stores the location of the PDU size, need to update after OID encoding.
-  
-  //Enterprise OID
-  _packetPos += pdu->value.OID.encode(_packet + _packetPos);
-  //adjust sizes now that OID is encoded.
-  _packetSize += pdu->value.OID.size-2;
-  _packet[1] += pdu->value.OID.size-2;
-  _packet[i] += pdu->value.OID.size-2;
-  
-  //Agent IP
-  value.encode_address(SNMP_SYNTAX_IP_ADDRESS, pdu->agent_address, _packet + _packetPos);
-  _packetPos += value.size;
-  
-  //trap type
-  value.encode(SNMP_SYNTAX_INT, (int16_t)trap_type, _packet + _packetPos);
-  _packetPos += value.size;
-  
+  pdu->version = 0;//Trap-PDU only exists in SNMPv1
+  _extra_data_size = 0;
+  _producer = NULL;
+
+  writer.begin(_txPacket, SNMP_MAX_PACKET_LEN);
+
+  //variable bindings, already encoded prior to function call
+  writer.push(pdu->value.data, pdu->value.size);
+  writer.close(SNMP_SYNTAX_SEQUENCE, 0);
+
+  //time-stamp
+  writer.push_unsigned(SNMP_SYNTAX_TIME_TICKS, uptime());
+
   //specific trap id
-  value.encode(SNMP_SYNTAX_INT, specific_trap, _packet + _packetPos);
-  _packetPos += value.size;
-  
-  //Time Ticks
-  //Similar error as previous commit in ArduinoSNMP.h.
-  //value.encode(SNMP_SYNTAX_TIME_TICKS, millis() / 10, _packet + _packetPos);
-  value.encode(SNMP_SYNTAX_TIME_TICKS, (const uint64_t)millis()/10, _packet + _packetPos);
-  _packetPos +=6;//syntax + length + 4 octets
+  writer.push_integer(SNMP_SYNTAX_INT, specific_trap);
 
-  //unknown
-  _packet[_packetPos++] = (byte) SNMP_SYNTAX_SEQUENCE;
-  _packet[_packetPos++] = (byte) 4 + pdu->value.size;
+  //generic trap type
+  writer.push_integer(SNMP_SYNTAX_INT, trap_type);
+
+  //agent-addr
+  for(i = 4; i > 0; i--){
+    writer.push(pdu->agent_address[i-1]);
+  }
+  writer.push_header(SNMP_SYNTAX_IP_ADDRESS, 4);
+
+  //enterprise OID
+  pdu->value.OID.encode(&writer);
 
-  //trap data, already encoded prior to function call
-  for ( i = 0; i < pdu->value.size; i++ ) {
-    _packet[_packetPos++] = pdu->value.data[i];
+  writer.close(SNMP_PDU_TRAP, 0);
+
+  this->writeHeaders(&writer, pdu->version);
+
+  //the writer has already overwritten the tail of the last message, it can't be resent
+  if(writer.overflow == true){
+    _segmentCount = 0;
+    _txSize = 0;
+    return 0;
   }
 
+  _txPos = writer.position;
+  _txSize = writer.size();
+  
+  _segmentCount = 0;
+  add_segment(_txPacket+_txPos, _txSize);
+
   writePacket(manager_address, SNMP_MANAGER_PORT);
 
   return pdu->requestId;
@@ -423,213 +529,1552 @@ uint32_t SNMPClass::sendTrapv1(SNMP_PDU *pdu, SNMP_TRAP_TYPES trap_type, int16_t
 
 /**
    * Generates SNMP header data.
+   *   Writes the community and version in front of the PDU already in writer and closes the message sequence.
    *
    * Original Auther: Rex Park
    * Updated: November 7, 2015 (Added support for Informs (SNMP_PDU_INFORM_REQUEST)
+   * Updated: Written through SNMP_BER_WRITER
    */
 
-uint16_t SNMPClass::writeHeaders(SNMP_PDU *pdu)
+void SNMPClass::writeHeaders(SNMP_BER_WRITER *writer, int32_t version)
 {
-  byte i;
-
   // SNMP community string
   if(_dstType == SNMP_PDU_SET){
-    for(i = _setSize-1; i >= 0 && i <= 30; i--){
-      _packet[_packetPos--] = (byte)_setCommName[i];
-    }
-    _packet[_packetPos--] = (byte)_setSize;	// length
+    writeMessageHeader(writer, version, _setCommName, _setSize);
   }else if(_dstType == SNMP_PDU_TRAP || _dstType == SNMP_PDU_TRAP2 || _dstType == SNMP_PDU_INFORM_REQUEST){
-    for(i = _trapSize-1; i >= 0 && i <= 30; i--){
-      _packet[_packetPos--] = (byte)_trapCommName[i];
-    }
-    _packet[_packetPos--] = (byte)_trapSize;	// length
+    writeMessageHeader(writer, version, _trapCommName, _trapSize);
   }else {
-    for(i = _getSize-1; i >= 0 && i <= 30; i--){
-      _packet[_packetPos--] = (byte)_getCommName[i];
-    }
-    _packet[_packetPos--] = (byte)_getSize;	// length
+    writeMessageHeader(writer, version, _getCommName, _getSize);
   }
-  _packet[_packetPos--] = (byte)SNMP_SYNTAX_OCTETS;// type
+}
+
+//version and community in front of the PDU, then the message sequence around everything
+void SNMPClass::writeMessageHeader(SNMP_BER_WRITER *writer, int32_t version, const char *community, size_t community_size)
+{
+  writer->push((const byte*)community, community_size);
+  writer->push_header(SNMP_SYNTAX_OCTETS, community_size);
   
   // version
-  _packet[_packetPos--] = (byte)pdu->version;// value
-  _packet[_packetPos--] = 0x01;			// length
-  _packet[_packetPos--] = (byte)SNMP_SYNTAX_INT;//type
+  writer->push_integer(SNMP_SYNTAX_INT, version);
   
   //start of header
   //length of all data after this point
-  _packet[_packetPos] = lsb(packet_length()+_extra_data_size);
-  _packet[_packetPos-1] = msb(packet_length()+_extra_data_size);
-  _packetPos -= 2;
-  _packet[_packetPos--] = 0x82;//Sending length in two octets
+  writer->close(SNMP_SYNTAX_SEQUENCE, 0);
+}
 
-  _packet[_packetPos--] = (byte)SNMP_SYNTAX_SEQUENCE;
+//closes the varbind list already in writer and writes the PDU fields and tag in front of it
+void SNMPClass::writePduHeader(SNMP_BER_WRITER *writer, SNMP_PDU_TYPES type, int32_t request_id, SNMP_ERR_CODES error, int32_t error_index)
+{
+  writer->close(SNMP_SYNTAX_SEQUENCE, 0);
   
-  //packet type
-  if ( _dstType == SNMP_PDU_SET ) {
-    _packetSize += _setSize;
-  } else if ( _dstType == SNMP_PDU_TRAP ) {
-    _packetSize += _trapSize;
-  } else {
-    _packetSize += _getSize;
-  }
+  // Error Index
+  writer->push_integer(SNMP_SYNTAX_INT, error_index);
+
+  // Error
+  writer->push_integer(SNMP_SYNTAX_INT, error);
 
-  return _packetPos;
+  // Request ID
+  writer->push_integer(SNMP_SYNTAX_INT, request_id);
+
+  // SNMP PDU type, length value of all previous data
+  writer->close(type, 0);
 }
 
-uint32_t SNMPClass::send_message(SNMP_PDU *pdu, IPAddress to_address, uint16_t to_port, byte *temp_buff, char *extra_data)
+/**
+ * Encodes and sends a response, v2 trap or inform.
+ *   Responses carry pdu->value as their single variable binding, traps and informs send
+ *   pdu->value.data as an already encoded list of variable bindings (see SNMP_PDU::add_data).
+ *   The message is built in one pass from the end of _txPacket with SNMP_BER_WRITER, the received request in _rxPacket
+ *   is left alone so notifications can be sent from request handlers.
+ *   A streamed response value (SNMP_VALUE::stream) is not copied into _txPacket, it is pulled from its producer while sending.
+ *   temp_buff is no longer used, it is kept so existing sketches still compile.
+ *
+ * Original Auther: Rex Park
+ */
+uint32_t SNMPClass::send_message(SNMP_PDU *pdu, IPAddress to_address, uint16_t to_port, byte *, char *extra_data)
 {
-  memset(_packet, 0, SNMP_MAX_PACKET_LEN);
-  _packetPos = SNMP_MAX_PACKET_LEN-1;
-  int32_u u;
-  int t = 0;
+  SNMP_BER_WRITER writer;
   _extra_data_size = 0;
+  _producer = NULL;
   
   if(extra_data != NULL){
     _extra_data_size = strlen(extra_data);
   }
 
+  writer.begin(_txPacket, SNMP_MAX_PACKET_LEN);
+
   // Varbind List
   if(pdu->type == SNMP_PDU_RESPONSE){
+    pdu->write_varbind(&writer, &pdu->value, _extra_data_size);
     
-    t = pdu->add_data_private(&pdu->value,_packet + _packetPos,true,temp_buff, _extra_data_size);
-    _packetPos -= t;
-    
-    
-    //length of entire value being passed
-    _packet[_packetPos--] = lsb(t+_extra_data_size);
-    _packet[_packetPos--] = msb(t+_extra_data_size);
-    _packet[_packetPos--] = 0x82;//Sending length in two octets
+    //streamed value contents follow the packet segments on the wire
+    _producer = pdu->value.producer;
+    _producerContext = pdu->value.producer_context;
+    _streamSize = pdu->value.stream_size;
     
   }else if(pdu->type == SNMP_PDU_TRAP2 || pdu->type == SNMP_PDU_INFORM_REQUEST){
-    //set and increment requestId
-    pdu->requestId = requestCounter++;
+    //a request id reserved beforehand (next_request_id) is kept, e.g. for a batch that was opened earlier
+    if(pdu->requestId == 0){
+      pdu->requestId = next_request_id();
+    }
       
-    for (t = pdu->value.size-1; t >= 0; t-- ) {
-      _packet[_packetPos--] = pdu->value.data[t];
-    }
-    //length of entire value being passed
-    _packet[_packetPos--] = lsb(pdu->value.size);
-    _packet[_packetPos--] = msb(pdu->value.size);
-    _packet[_packetPos--] = 0x82;//Sending length in two octets
-  }
-
-  _packet[_packetPos--] = (byte)SNMP_SYNTAX_SEQUENCE;// type
-  
-  // Error Index (size always 4 e.g. 4-byte int)
-  u.int32 = pdu->errorIndex;
-  _packet[_packetPos--] = u.data[0];
-  _packet[_packetPos--] = u.data[1];
-  _packet[_packetPos--] = u.data[2];
-  _packet[_packetPos--] = u.data[3];
-  _packet[_packetPos--] = 0x04;
-  _packet[_packetPos--] = (byte)SNMP_SYNTAX_INT;// type
-
-  // Error (size always 4 e.g. 4-byte int)
-  u.int32 = pdu->error;
-  _packet[_packetPos--] = u.data[0];
-  _packet[_packetPos--] = u.data[1];
-  _packet[_packetPos--] = u.data[2];
-  _packet[_packetPos--] = u.data[3];
-  _packet[_packetPos--] = 0x04;
-  _packet[_packetPos--] = (byte)SNMP_SYNTAX_INT;// type
-
-  // Request ID (size always 4 e.g. 4-byte int)
-  u.int32 = pdu->requestId;
-  _packet[_packetPos--] = u.data[0];
-  _packet[_packetPos--] = u.data[1];
-  _packet[_packetPos--] = u.data[2];
-  _packet[_packetPos--] = u.data[3];
-  _packet[_packetPos--] = 0x04;
-  _packet[_packetPos--] = (byte)SNMP_SYNTAX_INT;// type
-
-  //length value of all previous data
-  _packet[_packetPos] = lsb(packet_length()+_extra_data_size);
-  _packet[_packetPos-1] = msb(packet_length()+_extra_data_size);
-  _packetPos -= 2;
-  _packet[_packetPos--] = 0x82;//Sending length in two octets
-    
-  // SNMP PDU type
-  _packet[_packetPos--] = (byte)pdu->type;
+    writer.push(pdu->value.data, pdu->value.size);
+  }
+
+  writePduHeader(&writer, pdu->type, pdu->requestId, pdu->error, pdu->errorIndex);
 
   //data needed for header
   _dstType = pdu->type;
-  //byte header_size = this->writeHeaders(pdu);
-  this->writeHeaders(pdu);
+  this->writeHeaders(&writer, pdu->version);
+
+  //the writer has already overwritten the tail of the last message, it can't be resent
+  if(writer.overflow == true){
+    _segmentCount = 0;
+    _txSize = 0;
+    _producer = NULL;
+    return 0;
+  }
     
-  _packetSize = packet_length();
+  _txPos = writer.position;
+  _txSize = writer.size();
+  
+  //encoded packet, then borrowed bytes in the order they appear in the message
+  _segmentCount = 0;
+  add_segment(_txPacket+_txPos, _txSize);
+  add_segment((const byte*)extra_data, _extra_data_size);
+  if(pdu->type == SNMP_PDU_RESPONSE && pdu->value.borrowed != NULL){
+    add_segment(pdu->value.borrowed, pdu->value.stream_size);
+  }
   
 //  Serial.println("Outgoing: ");
-//  for(byte i = 0; i < _packetSize; i++){
-//    Serial.print(_packet[_packetPos+1+i],HEX);
+//  for(byte i = 0; i < _txSize; i++){
+//    Serial.print(_txPacket[_txPos+i],HEX);
 //    Serial.print("-");
 //  }
 //  Serial.println();
   
-  this->writePacket(to_address, to_port, extra_data);
+  this->writePacket(to_address, to_port);
+  
+  //the request is answered, its scratch memory can be reused
+  if(pdu->type == SNMP_PDU_RESPONSE){
+    _scratch.reset();
+  }
 
   return pdu->requestId;
 }
 
 /**
- * Copies an external byte array into _packet and then sends it out.
- * 
+ * Sends a v2 trap or inform built from a notification template.
+ *   values holds one encoded value (see SNMP_VALUE::set) for each object of the template, in the order they were added,
+ *   their OIDs are ignored. Streamed and borrowed values are not supported here.
+ *   Only sysUpTime and the request-id are encoded, the OIDs are copied from the template and the values from values[].
+ *   Returns the request-id, 0 if the template is not usable or the message did not fit.
+ *   Like send_message the message can be resent (resend_message) or copied (copy_packet) afterwards.
+ *
  * Original Auther: Rex Park
- * Added: November 8, 2015 (Designed to be used with a system that resends informs that haven't been acknowledged)
  */
-void SNMPClass::send_message(IPAddress address, uint16_t port, byte *packet, uint16_t packet_size){
-  Udp.beginPacket(address, port);
-  Udp.write(packet, packet_size);
-  Udp.endPacket();
+uint32_t SNMPClass::send_notification(SNMP_NOTIFICATION_TEMPLATE *notification, SNMP_VALUE *values, IPAddress to_address, uint16_t to_port)
+{
+  SNMP_BER_WRITER writer;
+  uint32_t request_id;
+  
+  _extra_data_size = 0;
+  _producer = NULL;
+  
+  writer.begin(_txPacket, SNMP_MAX_PACKET_LEN);
+  request_id = writeNotification(&writer, notification, values);
+  
+  _dstType = notification->type;
+  this->writeHeaders(&writer, 1);//v2c
+  
+  //the writer has already overwritten the tail of the last message, it can't be resent
+  if(request_id == 0 || writer.overflow == true){
+    _segmentCount = 0;
+    _txSize = 0;
+    return 0;
+  }
+  
+  _txPos = writer.position;
+  _txSize = writer.size();
+  
+  _segmentCount = 0;
+  add_segment(_txPacket+_txPos, _txSize);
+  
+  this->writePacket(to_address, to_port);
+  
+  return request_id;
 }
 
-void SNMPClass::writePacket(IPAddress address, uint16_t port, char *extra_data)
+/**
+ * Writes the PDU of a template notification, returns its request id or 0 if the template isn't usable.
+ *
+ * Original Auther: Rex Park
+ */
+uint32_t SNMPClass::writeNotification(SNMP_BER_WRITER *writer, SNMP_NOTIFICATION_TEMPLATE *notification, SNMP_VALUE *values)
 {
-  Udp.beginPacket(address, port);
-  Udp.write(_packet+_packetPos+1, _packetSize);
+  uint16_t m;
+  uint32_t request_id;
   
-  if(extra_data != NULL){
-    Udp.write((byte*)extra_data, _extra_data_size);
+  if(notification->overflow == true || notification->objects[0] == 0){
+    return 0;
   }
   
-  Udp.endPacket();
+  //object varbinds, last first
+  for(byte i = notification->object_count; i > 0; i--){
+    m = writer->mark();
+    writer->push(values[i-1].data, values[i-1].size);
+    writer->push(notification->encoded + notification->objects[i-1], notification->objects[i] - notification->objects[i-1]);
+    writer->close(SNMP_SYNTAX_SEQUENCE, m);
+  }
+  
+  //snmpTrapOID.0 varbind, complete in the template
+  writer->push(notification->encoded, notification->objects[0]);
+  
+  //sysUpTime.0
+  m = writer->mark();
+  writer->push_unsigned(SNMP_SYNTAX_TIME_TICKS, uptime());
+  writer->push(SNMP_SYS_UP_TIME_OID, sizeof(SNMP_SYS_UP_TIME_OID));
+  writer->close(SNMP_SYNTAX_SEQUENCE, m);
+  
+  request_id = next_request_id();
+  writePduHeader(writer, notification->type, request_id, SNMP_ERR_NO_ERROR, 0);
+  
+  return request_id;
+}
+
+/**
+ * sysUpTime in TimeTicks (hundredths of a second) since the board started, see SNMP_UPTIME.
+ *   Used for every notification and for sysUpTime.0, so they all agree.
+ *
+ * Original Auther: Rex Park
+ */
+uint32_t SNMPClass::uptime(){
+  return SNMPUptime.read();
+}
+
+/**
+ * Takes the next notification request id, 0 is skipped so it can mean "not assigned yet" (see send_message).
+ *   Reserve one ahead of time by storing it in the PDU's requestId before calling send_message.
+ *
+ * Original Auther: Rex Park
+ */
+uint32_t SNMPClass::next_request_id(){
+  if(requestCounter == 0){
+    requestCounter = 1;
+  }
+  return requestCounter++;
 }
 
-void SNMPClass::resend_message(IPAddress address, uint16_t port, char *extra_data)
+/**
+ * Sets a notification target, index is below SNMP_MAX_TARGETS.
+ *   Every notify() goes to each target with its own community, version and port.
+ *   Changing a target keeps the informs it still has to acknowledge, they are resent to the new address.
+ *   version is 1 for SNMPv2c, 0 for SNMPv1 managers. They get each notification as a v1 trap (RFC 3584),
+ *   informs included, which they can't acknowledge.
+ *
+ * Original Auther: Rex Park
+ */
+SNMP_API_STAT_CODES SNMPClass::set_target(byte index, IPAddress address, uint16_t port, const char *community, int32_t version)
 {
-  this->writePacket(address, port, extra_data);
+  if(index >= SNMP_MAX_TARGETS || community == NULL || (version != 0 && version != 1)){
+    return SNMP_API_STAT_PACKET_INVALID;
+  }
+  if(strlen(community) > SNMP_MAX_NAME_LEN){
+    return SNMP_API_STAT_NAME_TOO_BIG;
+  }
+  
+  _targets[index].address = address;
+  _targets[index].port = port == 0 ? SNMP_MANAGER_PORT : port;
+  _targets[index].community = community;
+  _targets[index].version = version;
+  
+  //informs waiting for this target go out with the next process_informs()
+  _nextInformCheck = millis();
+  
+  return SNMP_API_STAT_SUCCESS;
 }
 
-void SNMPClass::onPduReceive(onPduReceiveCallback pduReceived)
+//agent-addr of v1 traps translated from v2 notifications, usually the local IP
+void SNMPClass::set_agent_address(IPAddress address)
 {
-  _callback = pduReceived;
+  _agentAddress = address;
 }
 
-void SNMPClass::freePdu(SNMP_PDU *pdu)
+//stops sending to the target, informs it hadn't acknowledged are no longer waiting for it
+void SNMPClass::remove_target(byte index)
 {
-  pdu->clear();
+  if(index >= SNMP_MAX_TARGETS){
+    return;
+  }
+  
+  _targets[index].address = IPAddress(0, 0, 0, 0);
+  
+  for(byte i = _informCount; i > 0; i--){
+    if(_informs[i-1].pending & (1UL << index)){
+      _informs[i-1].pending &= ~(1UL << index);
+      _informs[i-1].inflight &= ~(1UL << index);
+      journalAck(_informs[i-1].request_id, _informs[i-1].pending);
+      
+      if(_informs[i-1].pending == 0){
+        removeInform(i-1);
+      }
+    }
+  }
 }
 
-uint16_t SNMPClass::copy_packet(byte *packet_store){
-  memcpy(packet_store,_packet+_packetPos+1,_packetSize);
+/**
+ * Sends a v2 trap or inform to every target.
+ *   The PDU is encoded once, only the community and version in front of it are written for each target.
+ *   Informs are kept (SNMP_MAX_PENDING_INFORMS, the oldest is dropped when full) and resent by process_informs()
+ *   to the targets that haven't acknowledged them yet. A target that already has SNMP_INFORM_WINDOW informs
+ *   to acknowledge gets it later, when one of them is acknowledged or given up on.
+ *   Targets whose filters or minimum severity exclude the notification are left out before anything is encoded.
+ *   severity is the application's own scale, higher is more severe.
+ *   Returns the request id, 0 if nothing was sent or kept.
+ *
+ * Original Auther: Rex Park
+ */
+uint32_t SNMPClass::notify(SNMP_PDU *pdu, byte severity)
+{
+  SNMP_BER_WRITER writer;
+  uint32_t targets;
+  
+  if(pdu->type != SNMP_PDU_TRAP2 && pdu->type != SNMP_PDU_INFORM_REQUEST){
+    return 0;
+  }
+  
+  //snmpTrapOID.0 is already encoded among the varbinds by prepare_trapv2
+  targets = filterTargets(pdu->value.data, pdu->value.size, severity);
+  if(targets == 0){
+    return 0;
+  }
+  
+  if(pdu->requestId == 0){
+    pdu->requestId = next_request_id();
+  }
+  
+  writer.begin(_txPacket, SNMP_MAX_PACKET_LEN);
+  writer.push(pdu->value.data, pdu->value.size);
+  writePduHeader(&writer, pdu->type, pdu->requestId, pdu->error, pdu->errorIndex);
+  
+  return sendToTargets(&writer, pdu->type, pdu->requestId, targets);
+}
 
-  return _packetSize;
+//template version, see send_notification for values
+uint32_t SNMPClass::notify(SNMP_NOTIFICATION_TEMPLATE *notification, SNMP_VALUE *values, byte severity)
+{
+  SNMP_BER_WRITER writer;
+  uint32_t request_id;
+  uint32_t targets;
+  
+  if(notification->overflow == true){
+    return 0;
+  }
+  
+  targets = filterTargets(notification->encoded, notification->objects[0], severity);
+  if(targets == 0){
+    return 0;
+  }
+  
+  writer.begin(_txPacket, SNMP_MAX_PACKET_LEN);
+  request_id = writeNotification(&writer, notification, values);
+  
+  if(request_id == 0){
+    _segmentCount = 0;
+    _txSize = 0;
+    return 0;
+  }
+  
+  return sendToTargets(&writer, notification->type, request_id, targets);
 }
 
-void SNMPClass::clear_packet(){
-  memset(_packet,0,SNMP_MAX_PACKET_LEN);
+/**
+ * Adds a subtree to a target's notification filter (SNMP-NOTIFICATION-MIB style, RFC 3413 section 6).
+ *   A target without filters gets every notification. Once it has some, a notification goes to it
+ *   only if the longest subtree containing its snmpTrapOID.0 is included.
+ *   The subtree is encoded here, notify() only compares bytes.
+ *
+ * Original Auther: Rex Park
+ */
+SNMP_API_STAT_CODES SNMPClass::add_filter(byte index, const SNMP_OID &subtree, boolean include)
+{
+  byte encoded[SNMP_FILTER_LEN + 8];
+  uint16_t length = subtree.encoded_length();
+  
+  //the first encoded byte holds two arcs
+  if(subtree.size < 2){
+    return SNMP_API_STAT_PACKET_INVALID;
+  }
+  if(length > SNMP_FILTER_LEN || length > 255){
+    return SNMP_API_STAT_MALLOC_ERR;
+  }
+  
+  subtree.encode(encoded);
+  return add_filter(index, encoded + 1 + SNMP_BER_WRITER::length_size(length), length, include);
 }
 
-IPAddress SNMPClass::remoteIP(){
-  return Udp.remoteIP();
+//pre-encoded arcs, BER contents without syntax or length
+SNMP_API_STAT_CODES SNMPClass::add_filter(byte index, const byte *subtree, byte length, boolean include)
+{
+  byte i;
+  
+  if(index >= SNMP_MAX_TARGETS || length == 0 || (subtree[length-1] & 0x80)){
+    return SNMP_API_STAT_PACKET_INVALID;
+  }
+  if(_filterCount == SNMP_MAX_FILTERS || _filterUsed + length > SNMP_FILTER_LEN){
+    return SNMP_API_STAT_MALLOC_ERR;
+  }
+  
+  //insertion keeps them longest first
+  for(i = _filterCount; i > 0 && _filters[i-1].size < length; i--){
+    _filters[i] = _filters[i-1];
+  }
+  _filters[i].offset = _filterUsed;
+  _filters[i].size = length;
+  _filters[i].target = index;
+  _filters[i].include = include;
+  _filterCount++;
+  
+  memcpy(_filterOids + _filterUsed, subtree, length);
+  _filterUsed += length;
+  _filtered |= 1UL << index;
+  
+  return SNMP_API_STAT_SUCCESS;
 }
 
-uint16_t SNMPClass::remotePort(){
-  return Udp.remotePort();
+//the target gets every notification again
+void SNMPClass::clear_filters(byte index)
+{
+  byte kept = 0;
+  uint16_t used = 0;
+  
+  for(byte i = 0; i < _filterCount; i++){
+    if(_filters[i].target == index){
+      continue;
+    }
+    
+    //compacts the encoded subtrees, offsets only move down
+    memmove(_filterOids + used, _filterOids + _filters[i].offset, _filters[i].size);
+    _filters[kept] = _filters[i];
+    _filters[kept].offset = used;
+    used += _filters[i].size;
+    kept++;
+  }
+  
+  _filterCount = kept;
+  _filterUsed = used;
+  _filtered &= ~(1UL << index);
+}
+
+//notifications sent with a lower severity skip the target
+void SNMPClass::set_min_severity(byte index, byte severity)
+{
+  if(index < SNMP_MAX_TARGETS){
+    _targets[index].min_severity = severity;
+  }
+}
+
+/**
+ * Targets a notification may go to (bit 1 << index), found from the snmpTrapOID.0 varbind among varbinds.
+ *   One pass over the filters, longest first, settles each filtered target on its most specific subtree.
+ *
+ * Original Auther: Rex Park
+ */
+uint32_t SNMPClass::filterTargets(const byte *varbinds, uint16_t size, byte severity)
+{
+  uint32_t targets = 0;
+  uint32_t decided = 0;
+  const byte *trap_oid = NULL;
+  uint16_t trap_oid_size = 0;
+  uint16_t pos = 0, h, length;
+  byte tag, t;
+  
+  for(t = 0; t < SNMP_MAX_TARGETS; t++){
+    if((uint32_t)_targets[t].address != 0 && severity >= _targets[t].min_severity){
+      targets |= 1UL << t;
+    }
+  }
+  
+  if((targets & _filtered) == 0){
+    return targets;
+  }
+  
+  while(pos < size && trap_oid == NULL){
+    h = readHeader(varbinds + pos, size - pos, &tag, &length);
+    if(h == 0 || tag != SNMP_SYNTAX_SEQUENCE){
+      break;
+    }
+    if(length > sizeof(SNMP_TRAP_OID_OID) && memcmp(varbinds + pos + h, SNMP_TRAP_OID_OID, sizeof(SNMP_TRAP_OID_OID)) == 0){
+      uint16_t value = pos + h + sizeof(SNMP_TRAP_OID_OID);
+      uint16_t value_h = readHeader(varbinds + value, pos + h + length - value, &tag, &trap_oid_size);
+      if(value_h != 0 && tag == SNMP_SYNTAX_OID){
+        trap_oid = varbinds + value + value_h;
+      }
+    }
+    pos += h + length;
+  }
+  
+  //without a notification OID no filter can include it
+  if(trap_oid == NULL){
+    return targets & ~_filtered;
+  }
+  
+  decided = ~_filtered;
+  for(byte i = 0; i < _filterCount; i++){
+    SNMP_FILTER *f = &_filters[i];
+    uint32_t bit = 1UL << f->target;
+    
+    if((decided & bit) == 0 && f->size <= trap_oid_size && memcmp(_filterOids + f->offset, trap_oid, f->size) == 0){
+      decided |= bit;
+      if(f->include == false){
+        targets &= ~bit;
+      }
+    }
+  }
+  
+  //filtered targets no subtree matched
+  return targets & decided;
 }
 
-uint16_t SNMPClass::packet_length(){
-  return SNMP_MAX_PACKET_LEN - _packetPos - 1;
+//pdu holds an encoded PDU, it is sent to the targets (bit 1 << index) and kept if it is an inform
+uint32_t SNMPClass::sendToTargets(SNMP_BER_WRITER *pdu, SNMP_PDU_TYPES type, uint32_t request_id, uint32_t targets)
+{
+  uint32_t acknowledging = 0;
+  boolean any = false;
+  unsigned long now = millis();
+  
+  //the PDU was written over the last message, it can't be resent
+  if(pdu->overflow == true){
+    _segmentCount = 0;
+    _txSize = 0;
+    return 0;
+  }
+  
+  _extra_data_size = 0;
+  _producer = NULL;
+  
+  for(byte t = 0; t < SNMP_MAX_TARGETS; t++){
+    if((targets & (1UL << t)) == 0 || (uint32_t)_targets[t].address == 0){
+      continue;
+    }
+    
+    //v1 targets get a trap, there is no acknowledgement to wait for
+    if(type == SNMP_PDU_INFORM_REQUEST && _targets[t].version != 0){
+      acknowledging |= 1UL << t;
+    }else if(sendToTarget(pdu, t) == true){
+      any = true;
+    }
+  }
+  
+  if(acknowledging != 0){
+    uint32_t freed = 0;
+    
+    //full, the oldest is given up on. Its window slots go to the informs waiting behind it
+    if(_informCount == SNMP_MAX_PENDING_INFORMS){
+      freed = _informs[0].inflight;
+      dropInform(0);
+    }
+    
+    SNMP_PENDING_INFORM *inform = &_informs[_informCount++];
+    inform->request_id = request_id;
+    inform->pending = acknowledging;
+    inform->inflight = 0;
+    inform->size = pdu->size();
+    memcpy(inform->pdu, pdu->data(), inform->size);
+    
+    journalInform(_informCount - 1);
+    
+    //oldest first, the new inform only goes out now if nothing older is waiting for the target
+    for(byte t = 0; t < SNMP_MAX_TARGETS; t++){
+      if((acknowledging | freed) & (1UL << t)){
+        releaseInforms(t, now);
+      }
+    }
+    any = true;
+  }
+  
+  return any == true ? request_id : 0;
+}
+
+/**
+ * Writes one target's message header in front of the PDU and sends it.
+ *   The PDU in pdu is not changed, the next target's header overwrites this one.
+ */
+boolean SNMPClass::sendToTarget(const SNMP_BER_WRITER *pdu, byte target)
+{
+  SNMP_TARGET *t = &_targets[target];
+  SNMP_BER_WRITER writer = *pdu;
+  
+  if((uint32_t)t->address == 0){
+    return false;
+  }
+  
+  if(t->version == 0){
+    return sendTranslatedTrap(pdu, target);
+  }
+  
+  writeMessageHeader(&writer, t->version, t->community, strlen(t->community));
+  
+  if(writer.overflow == true){
+    _segmentCount = 0;
+    _txSize = 0;
+    return false;
+  }
+  
+  _txPos = writer.position;
+  _txSize = writer.size();
+  
+  _segmentCount = 0;
+  add_segment(_txPacket+_txPos, _txSize);
+  
+  this->writePacket(t->address, t->port);
+  
+  return true;
+}
+
+/**
+ * Sends an encoded v2 trap or inform PDU to a v1 target as a Trap-PDU (RFC 3584 section 3.2).
+ *   snmpTrapOID.0 gives the enterprise, generic-trap and specific-trap, sysUpTime.0 the time-stamp.
+ *   Those two, snmpTrapEnterprise.0 and Counter64 varbinds (no v1 syntax) are left out, the other varbinds
+ *   are sent from where they are in the v2 PDU. Only the v1 fields are encoded, into a stack buffer.
+ *   Returns false if the PDU can't be translated or needs more than SNMP_MAX_SEGMENTS pieces.
+ *
+ * Original Auther: Rex Park
+ */
+boolean SNMPClass::sendTranslatedTrap(const SNMP_BER_WRITER *pdu, byte target)
+{
+  SNMP_TARGET *t = &_targets[target];
+  byte header[SNMP_TRAP1_HEADER_LEN];
+  SNMP_BER_WRITER writer;
+  const byte *data = pdu->data();
+  uint16_t size = pdu->size();
+  uint16_t pos, end, h, length;
+  byte tag;
+  const byte *trap_oid = NULL;
+  byte trap_oid_size = 0;
+  const byte *enterprise = NULL;
+  byte enterprise_size = 0;
+  const byte *timestamp = NULL;
+  byte timestamp_size = 0;
+  int32_t generic = SNMP_TRAP_ENTERPRISE_SPECIFIC;
+  int32_t specific = 0;
+  uint16_t kept = 0;
+  byte count = 1;//segments, the header goes first
+  byte i;
+  
+  //the PDU was written over the last message, it can't be resent. _segmentCount stays 0
+  //until the translation is complete, so every failure below leaves nothing to resend
+  _segmentCount = 0;
+  _txSize = 0;
+  
+  //PDU tag, request-id, error-status, error-index, then the varbind list
+  h = readHeader(data, size, &tag, &length);
+  if(h == 0 || (tag != SNMP_PDU_TRAP2 && tag != SNMP_PDU_INFORM_REQUEST)){
+    return false;
+  }
+  pos = h;
+  for(i = 0; i < 3; i++){
+    h = readHeader(data + pos, size - pos, &tag, &length);
+    if(h == 0){ return false; }
+    pos += h + length;
+  }
+  h = readHeader(data + pos, size - pos, &tag, &length);
+  if(h == 0 || tag != SNMP_SYNTAX_SEQUENCE){
+    return false;
+  }
+  pos += h;
+  end = pos + length;
+  
+  //varbinds that are sent as they are become segments, neighbours are merged
+  while(pos < end){
+    uint16_t vb_start = pos;
+    uint16_t vb_length;
+    
+    h = readHeader(data + pos, end - pos, &tag, &vb_length);
+    if(h == 0 || tag != SNMP_SYNTAX_SEQUENCE){ return false; }
+    uint16_t vb_end = pos + h + vb_length;
+    pos += h;
+    
+    //OID including syntax and length, so it can be compared with the encoded constants
+    const byte *oid = data + pos;
+    h = readHeader(oid, vb_end - pos, &tag, &length);
+    if(h == 0 || tag != SNMP_SYNTAX_OID){ return false; }
+    uint16_t oid_size = h + length;
+    pos += oid_size;
+    
+    const byte *value = data + pos;
+    h = readHeader(value, vb_end - pos, &tag, &length);
+    if(h == 0){ return false; }
+    pos = vb_end;
+    
+    if(oid_size == sizeof(SNMP_SYS_UP_TIME_OID) && memcmp(oid, SNMP_SYS_UP_TIME_OID, oid_size) == 0){
+      timestamp = value + h;
+      timestamp_size = length;
+      continue;
+    }
+    if(oid_size == sizeof(SNMP_TRAP_OID_OID) && memcmp(oid, SNMP_TRAP_OID_OID, oid_size) == 0){
+      if(tag != SNMP_SYNTAX_OID || length == 0 || length > 255){ return false; }
+      trap_oid = value + h;
+      trap_oid_size = length;
+      continue;
+    }
+    if(oid_size == sizeof(SNMP_TRAP_ENTERPRISE_OID) && memcmp(oid, SNMP_TRAP_ENTERPRISE_OID, oid_size) == 0){
+      if(tag == SNMP_SYNTAX_OID && length <= 255){
+        enterprise = value + h;
+        enterprise_size = length;
+      }
+      continue;
+    }
+    if(tag == SNMP_SYNTAX_COUNTER64){
+      continue;
+    }
+    
+    //kept, continues the last segment when it follows it directly
+    if(count > 1 && _segments[count-1].data + _segments[count-1].size == data + vb_start){
+      _segments[count-1].size += vb_end - vb_start;
+    }else if(count < SNMP_MAX_SEGMENTS){
+      _segments[count].data = data + vb_start;
+      _segments[count].size = vb_end - vb_start;
+      count++;
+    }else{
+      return false;
+    }
+    kept += vb_end - vb_start;
+  }
+  
+  if(trap_oid == NULL){
+    return false;
+  }
+  
+  //one of the generic traps: snmpTraps.(generic + 1)
+  if(trap_oid_size == sizeof(SNMP_TRAPS_ARCS) + 1 && memcmp(trap_oid, SNMP_TRAPS_ARCS, sizeof(SNMP_TRAPS_ARCS)) == 0
+      && trap_oid[trap_oid_size-1] >= 1 && trap_oid[trap_oid_size-1] <= 6){
+    generic = trap_oid[trap_oid_size-1] - 1;
+    if(enterprise == NULL){
+      enterprise = SNMP_TRAPS_ARCS;
+      enterprise_size = sizeof(SNMP_TRAPS_ARCS);
+    }
+  }else{
+    //enterprise specific: the last arc is the specific trap, the enterprise is what comes before it,
+    //without the 0 arc that v1 traps converted to v2 (RFC 3584 section 3.1) have in front of it
+    byte last = trap_oid_size - 1;
+    while(last > 0 && (trap_oid[last-1] & 0x80)){
+      last--;
+    }
+    for(i = last; i < trap_oid_size; i++){
+      specific = (specific << 7) | (trap_oid[i] & 0x7f);
+    }
+    
+    enterprise = trap_oid;
+    enterprise_size = last;
+    if(last > 1 && trap_oid[last-1] == 0 && !(trap_oid[last-2] & 0x80)){
+      enterprise_size = last - 1;
+    }
+  }
+  
+  writer.begin(header, sizeof(header));
+  
+  //variable bindings follow the header as segments
+  writer.trailing(kept);
+  writer.close(SNMP_SYNTAX_SEQUENCE, 0);
+  
+  //time-stamp
+  if(timestamp != NULL){
+    writer.push(timestamp, timestamp_size);
+    writer.push_header(SNMP_SYNTAX_TIME_TICKS, timestamp_size);
+  }else{
+    writer.push_unsigned(SNMP_SYNTAX_TIME_TICKS, uptime());
+  }
+  
+  writer.push_integer(SNMP_SYNTAX_INT, specific);
+  writer.push_integer(SNMP_SYNTAX_INT, generic);
+  
+  //agent-addr
+  for(i = 4; i > 0; i--){
+    writer.push(_agentAddress[i-1]);
+  }
+  writer.push_header(SNMP_SYNTAX_IP_ADDRESS, 4);
+  
+  //enterprise
+  writer.push(enterprise, enterprise_size);
+  writer.push_header(SNMP_SYNTAX_OID, enterprise_size);
+  
+  writer.close(SNMP_PDU_TRAP, 0);
+  writeMessageHeader(&writer, 0, t->community, strlen(t->community));
+  
+  if(writer.overflow == true){
+    return false;
+  }
+  
+  _segments[0].data = writer.data();
+  _segments[0].size = writer.size();
+  _segmentCount = count;
+  
+  this->writePacket(t->address, t->port);
+  
+  //the segments point into this function's stack, they can't be resent
+  _segmentCount = 0;
+  
+  return true;
+}
+
+//reads a tag and length at data, returns the header size or 0 if it doesn't fit in size bytes
+uint16_t SNMPClass::readHeader(const byte *data, uint16_t size, byte *tag, uint16_t *length)
+{
+  uint16_t h;
+  
+  if(size < 2){
+    return 0;
+  }
+  
+  *tag = data[0];
+  if(data[1] < 0x80){
+    *length = data[1];
+    h = 2;
+  }else if(data[1] == 0x81 && size >= 3){
+    *length = data[2];
+    h = 3;
+  }else if(data[1] == 0x82 && size >= 4){
+    *length = combine_msb_lsb(data[2], data[3]);
+    h = 4;
+  }else{
+    return 0;
+  }
+  
+  return *length <= size - h ? h : 0;
+}
+
+//how long a target has to acknowledge an inform before it is sent again
+void SNMPClass::set_inform_timeout(unsigned long timeout_ms)
+{
+  _informTimeout = timeout_ms;
+  _nextInformCheck = millis();//recalculate deadline with the new timeout
+}
+
+/**
+ * Resends informs that timed out, only to the targets that haven't acknowledged them.
+ *   Each target's resend interval starts at the inform timeout and doubles with every resend
+ *   (SNMP_INFORM_BACKOFF_STEPS times at most), +-25% at random so informs that went out together
+ *   don't come back together. After SNMP_INFORM_RETRIES resends the target is given up on for that inform,
+ *   which counts in informs_dropped() and makes room in its window for the next one.
+ *   Call it often, e.g. from loop(). Nothing is scanned before the earliest deadline.
+ *
+ * Original Auther: Rex Park
+ */
+void SNMPClass::process_informs()
+{
+  unsigned long now = millis();
+  byte used[SNMP_MAX_TARGETS];
+  byte i, t;
+  
+  if(_journal.buffered > 0 && now - _journal.buffered_at >= SNMP_JOURNAL_FLUSH_MS){
+    journal_flush();
+  }
+  
+  if(_informCount == 0 || (long)(now - _nextInformCheck) < 0){
+    return;
+  }
+  
+  for(t = 0; t < SNMP_MAX_TARGETS; t++){
+    used[t] = windowUsed(t);
+  }
+  
+  //oldest first, so an inform given up on makes room for the next one in the same pass
+  i = 0;
+  while(i < _informCount){
+    SNMP_PENDING_INFORM *inform = &_informs[i];
+    
+    for(t = 0; t < SNMP_MAX_TARGETS; t++){
+      uint32_t bit = 1UL << t;
+      
+      if((inform->pending & bit) == 0){
+        continue;
+      }
+      
+      if(inform->inflight & bit){
+        if((long)(now - inform->due[t]) < 0){
+          continue;
+        }
+        
+        if(inform->retries[t] >= SNMP_INFORM_RETRIES){
+          inform->pending &= ~bit;
+          inform->inflight &= ~bit;
+          _targets[t].dropped++;
+          used[t]--;
+          journalAck(inform->request_id, inform->pending);
+          continue;
+        }
+        
+        inform->retries[t]++;
+        sendInform(i, t, now);
+      }else if(used[t] < SNMP_INFORM_WINDOW && (uint32_t)_targets[t].address != 0){
+        sendInform(i, t, now);
+        used[t]++;
+      }
+    }
+    
+    if(inform->pending == 0){
+      removeInform(i);
+    }else{
+      i++;
+    }
+  }
+  
+  //informs waiting for room in a window need no deadline, an acknowledgement or a drop releases them
+  _nextInformCheck = now + (_informTimeout << SNMP_INFORM_BACKOFF_STEPS);
+  for(i = 0; i < _informCount; i++){
+    for(t = 0; t < SNMP_MAX_TARGETS; t++){
+      if((_informs[i].inflight & (1UL << t)) && (long)(_informs[i].due[t] - _nextInformCheck) < 0){
+        _nextInformCheck = _informs[i].due[t];
+      }
+    }
+  }
+}
+
+/**
+ * Records an inform response (pdu.requestId, remoteIP(), remotePort()).
+ *   Clears the target it came from, matched on address and port and then on address alone.
+ *   The inform is released when every target has acknowledged it.
+ *   Returns false if no target was waiting for it.
+ *
+ * Original Auther: Rex Park
+ */
+boolean SNMPClass::acknowledge(uint32_t request_id, IPAddress address, uint16_t port)
+{
+  for(byte i = 0; i < _informCount; i++){
+    SNMP_PENDING_INFORM *inform = &_informs[i];
+    
+    if(inform->request_id != request_id){
+      continue;
+    }
+    
+    for(byte pass = 0; pass < 2; pass++){
+      for(byte t = 0; t < SNMP_MAX_TARGETS; t++){
+        if((inform->pending & (1UL << t)) && _targets[t].address == address && (pass == 1 || _targets[t].port == port)){
+          inform->pending &= ~(1UL << t);
+          inform->inflight &= ~(1UL << t);
+          journalAck(request_id, inform->pending);
+          
+          if(inform->pending == 0){
+            removeInform(i);
+          }
+          
+          //ack clocked, the next inform waiting for this target goes out now
+          releaseInforms(t, millis());
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+  
+  return false;
+}
+
+//stops resending an inform, whichever targets haven't acknowledged it
+boolean SNMPClass::cancel_inform(uint32_t request_id)
+{
+  for(byte i = 0; i < _informCount; i++){
+    if(_informs[i].request_id == request_id){
+      _informs[i].pending = 0;
+      journalAck(request_id, 0);
+      removeInform(i);
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+byte SNMPClass::pending_informs()
+{
+  return _informCount;
+}
+
+//informs given up on for a target since begin(), by retries or by a full table
+uint16_t SNMPClass::informs_dropped(byte index)
+{
+  return index < SNMP_MAX_TARGETS ? _targets[index].dropped : 0;
+}
+
+//removes an inform that targets are still waiting for, each of them counts it as dropped
+void SNMPClass::dropInform(byte index)
+{
+  for(byte t = 0; t < SNMP_MAX_TARGETS; t++){
+    if(_informs[index].pending & (1UL << t)){
+      _targets[t].dropped++;
+    }
+  }
+  
+  removeInform(index);
+}
+
+//informs sent to the target that it hasn't acknowledged
+byte SNMPClass::windowUsed(byte target)
+{
+  byte used = 0;
+  
+  for(byte i = 0; i < _informCount; i++){
+    if(_informs[i].inflight & (1UL << target)){
+      used++;
+    }
+  }
+  
+  return used;
+}
+
+//sends a kept inform to one target and sets when it is due again
+void SNMPClass::sendInform(byte index, byte target, unsigned long now)
+{
+  SNMP_PENDING_INFORM *inform = &_informs[index];
+  SNMP_BER_WRITER writer;
+  unsigned long interval;
+  
+  if((inform->inflight & (1UL << target)) == 0){
+    inform->inflight |= 1UL << target;
+    inform->retries[target] = 0;
+  }
+  
+  writer.begin(_txPacket, SNMP_MAX_PACKET_LEN);
+  writer.push(inform->pdu, inform->size);
+  
+  _extra_data_size = 0;
+  _producer = NULL;
+  
+  sendToTarget(&writer, target);
+  
+  interval = _informTimeout << (inform->retries[target] < SNMP_INFORM_BACKOFF_STEPS ? inform->retries[target] : SNMP_INFORM_BACKOFF_STEPS);
+  inform->due[target] = now + interval - interval/4 + random(interval/2 + 1);
+  
+  if((long)(inform->due[target] - _nextInformCheck) < 0){
+    _nextInformCheck = inform->due[target];
+  }
+}
+
+//sends the oldest informs waiting for the target while its window has room
+void SNMPClass::releaseInforms(byte target, unsigned long now)
+{
+  byte used = windowUsed(target);
+  
+  for(byte i = 0; i < _informCount && used < SNMP_INFORM_WINDOW; i++){
+    if((_informs[i].pending & ~_informs[i].inflight) & (1UL << target)){
+      sendInform(i, target, now);
+      used++;
+    }
+  }
+}
+
+//keeps the table oldest first
+void SNMPClass::removeInform(byte index)
+{
+  _informCount--;
+  
+  if(index < _informCount){
+    memmove(&_informs[index], &_informs[index+1], (_informCount - index) * sizeof(SNMP_PENDING_INFORM));
+  }
+}
+
+/**
+ * Keeps the pending inform table on storage so informs survive a reset (see SNMP_JOURNAL).
+ *   size is the number of bytes the callbacks can address from 0, at least SNMP_JOURNAL_MIN_SIZE. That holds
+ *   two copies of a full table, one more record and the superblocks.
+ *   Informs found on storage are loaded into the table and resent by the next process_informs(),
+ *   call it after begin() and set_target(), the pending targets are stored by index.
+ *   Storage that doesn't hold a journal is started empty.
+ *
+ * Original Auther: Rex Park
+ */
+SNMP_API_STAT_CODES SNMPClass::attach_journal(uint32_t size, journalReadCallback read, journalWriteCallback write, void *context)
+{
+  _journal.read = NULL;
+  _journal.write = NULL;
+  
+  if(read == NULL || write == NULL){
+    return SNMP_API_STAT_PACKET_INVALID;
+  }
+  if(size < SNMP_JOURNAL_MIN_SIZE){
+    return SNMP_API_STAT_MALLOC_ERR;
+  }
+  
+  _journal.read = read;
+  _journal.write = write;
+  _journal.context = context;
+  _journal.ring_size = size - SNMP_JOURNAL_RING_START;
+  _journal.buffered = 0;
+  _journal.failed = 0;
+  
+  if(journalReplay() == false){
+    //nothing usable on storage
+    _journal.head = 0;
+    _journal.tail = 0;
+    _journal.used = 0;
+    _journal.sequence = 1;
+    _journal.generation = 0;
+    journalCheckpoint();
+  }
+  
+  return SNMP_API_STAT_SUCCESS;
+}
+
+//writes buffered journal records now, false if the write failed
+boolean SNMPClass::journal_flush()
+{
+  boolean ok = true;
+  
+  if(_journal.write == NULL || _journal.buffered == 0){
+    return true;
+  }
+  
+  if(journalWriteRing((_journal.head + _journal.ring_size - _journal.buffered) % _journal.ring_size, _journal.buffer, _journal.buffered) == false){
+    _journal.failed++;
+    ok = false;
+  }
+  _journal.buffered = 0;
+  return ok;
+}
+
+//journal writes that failed since attach_journal, the journal may be missing informs
+uint16_t SNMPClass::journal_failures()
+{
+  return _journal.failed;
+}
+
+//records the inform at index, or checkpoints the whole table when the ring is out of space
+void SNMPClass::journalInform(byte index)
+{
+  SNMP_PENDING_INFORM *inform = &_informs[index];
+  
+  if(_journal.write == NULL){
+    return;
+  }
+  
+  if(_journal.used + SNMP_JOURNAL_OVERHEAD + inform->size + SNMP_JOURNAL_LIVE_MAX > _journal.ring_size){
+    journalCheckpoint();
+  }else{
+    journalRecord(SNMP_JOURNAL_ENQUEUE, inform->request_id, inform->pending, inform->pdu, inform->size);
+  }
+}
+
+//records the targets an inform is still waiting for, 0 when it is done
+void SNMPClass::journalAck(uint32_t request_id, uint32_t pending)
+{
+  if(_journal.write == NULL){
+    return;
+  }
+  
+  //the checkpoint is written from the table, callers update it first
+  if(_journal.used + SNMP_JOURNAL_OVERHEAD + SNMP_JOURNAL_LIVE_MAX > _journal.ring_size){
+    journalCheckpoint();
+  }else{
+    journalRecord(SNMP_JOURNAL_ACK, request_id, pending, NULL, 0);
+  }
+}
+
+void SNMPClass::journalRecord(byte type, uint32_t request_id, uint32_t pending, const byte *pdu, uint16_t pdu_size)
+{
+  byte header[16];
+  byte trailer[2];
+  uint16_t length = 8 + pdu_size;
+  uint16_t check;
+  
+  header[0] = 'J';
+  header[1] = type;
+  put_uint32(header + 2, _journal.sequence);
+  header[6] = length >> 8;
+  header[7] = length & 0xFF;
+  put_uint32(header + 8, request_id);
+  put_uint32(header + 12, pending);
+  
+  check = fletcher16(0, header + 1, sizeof(header) - 1);
+  check = fletcher16(check, pdu, pdu_size);
+  trailer[0] = check >> 8;
+  trailer[1] = check & 0xFF;
+  
+  journalAppend(header, sizeof(header));
+  journalAppend(pdu, pdu_size);
+  journalAppend(trailer, sizeof(trailer));
+  
+  _journal.sequence++;
+}
+
+//adds bytes at head, through the buffer unless they are larger than it
+void SNMPClass::journalAppend(const byte *data, uint16_t size)
+{
+  if(size == 0){
+    return;
+  }
+  
+  if(_journal.buffered + size > SNMP_JOURNAL_BUFFER_LEN){
+    journal_flush();
+  }
+  
+  if(size > SNMP_JOURNAL_BUFFER_LEN){
+    if(journalWriteRing(_journal.head, data, size) == false){
+      _journal.failed++;
+    }
+  }else{
+    if(_journal.buffered == 0){
+      _journal.buffered_at = millis();
+    }
+    memcpy(_journal.buffer + _journal.buffered, data, size);
+    _journal.buffered += size;
+  }
+  
+  _journal.head = (_journal.head + size) % _journal.ring_size;
+  _journal.used += size;
+}
+
+//ring offsets wrap at ring_size, a write across the end is split in two
+boolean SNMPClass::journalWriteRing(uint32_t offset, const byte *data, uint16_t size)
+{
+  uint32_t first = _journal.ring_size - offset;
+  
+  if(first > size){
+    first = size;
+  }
+  
+  if(_journal.write(SNMP_JOURNAL_RING_START + offset, data, first, _journal.context) == false){
+    return false;
+  }
+  return first == size || _journal.write(SNMP_JOURNAL_RING_START, data + first, size - first, _journal.context);
+}
+
+boolean SNMPClass::journalReadRing(uint32_t offset, byte *data, uint16_t size)
+{
+  uint32_t first = _journal.ring_size - offset;
+  
+  if(first > size){
+    first = size;
+  }
+  
+  if(_journal.read(SNMP_JOURNAL_RING_START + offset, data, first, _journal.context) == false){
+    return false;
+  }
+  return first == size || _journal.read(SNMP_JOURNAL_RING_START, data + first, size - first, _journal.context);
+}
+
+/**
+ * Writes every pending inform again at the head, then points the other superblock at the first of them.
+ *   Everything before that is no longer needed. A reset before the superblock is written replays from
+ *   the old tail, which still leads to the same table.
+ *   If the records can't be written the superblock isn't either, the old tail stays the replay point and
+ *   the head goes back so the next checkpoint reuses the space.
+ *
+ * Original Auther: Rex Park
+ */
+void SNMPClass::journalCheckpoint()
+{
+  byte block[SNMP_JOURNAL_SUPERBLOCK_LEN];
+  uint32_t tail = _journal.head;
+  uint32_t tail_sequence = _journal.sequence;
+  uint32_t used = _journal.used;
+  uint16_t failed;
+  uint16_t check;
+  
+  //records already buffered belong to the old tail, only the checkpoint's own writes decide below
+  journal_flush();
+  failed = _journal.failed;
+  
+  //an inform that was just acknowledged by its last target is still in the table
+  for(byte i = 0; i < _informCount; i++){
+    if(_informs[i].pending == 0){
+      continue;
+    }
+    journalRecord(SNMP_JOURNAL_ENQUEUE, _informs[i].request_id, _informs[i].pending, _informs[i].pdu, _informs[i].size);
+  }
+  
+  //records larger than the buffer are written directly, failed counts those too
+  if(journal_flush() == false || _journal.failed != failed){
+    _journal.head = tail;
+    _journal.sequence = tail_sequence;
+    _journal.used = used;
+    return;
+  }
+  
+  block[0] = 'S';
+  block[1] = 'N';
+  put_uint32(block + 2, _journal.generation + 1);
+  put_uint32(block + 6, tail);
+  put_uint32(block + 10, tail_sequence);
+  check = fletcher16(0, block, 14);
+  block[14] = check >> 8;
+  block[15] = check & 0xFF;
+  
+  //alternate superblocks, the previous one stays valid until this write is complete
+  if(_journal.write(((_journal.generation + 1) & 1) * SNMP_JOURNAL_SUPERBLOCK_LEN, block, sizeof(block), _journal.context) == false){
+    _journal.failed++;
+    return;
+  }
+  
+  _journal.generation++;
+  _journal.tail = tail;
+  _journal.used -= used;
+}
+
+/**
+ * Loads the pending informs recorded on storage into the table.
+ *   Returns false if neither superblock is valid.
+ *
+ * Original Auther: Rex Park
+ */
+boolean SNMPClass::journalReplay()
+{
+  byte block[SNMP_JOURNAL_SUPERBLOCK_LEN];
+  byte header[16];
+  byte trailer[2];
+  boolean found = false;
+  uint32_t generation = 0;
+  uint32_t tail = 0;
+  uint32_t sequence = 0;
+  uint32_t position, used, request_id, pending;
+  uint32_t next_request = 0;
+  uint16_t length, pdu_size, check;
+  byte i;
+  
+  for(byte slot = 0; slot < 2; slot++){
+    if(_journal.read(slot * SNMP_JOURNAL_SUPERBLOCK_LEN, block, sizeof(block), _journal.context) == false){
+      continue;
+    }
+    check = fletcher16(0, block, 14);
+    if(block[0] != 'S' || block[1] != 'N' || block[14] != (check >> 8) || block[15] != (check & 0xFF)){
+      continue;
+    }
+    if(get_uint32(block + 6) >= _journal.ring_size){
+      continue;
+    }
+    if(found == false || (int32_t)(get_uint32(block + 2) - generation) > 0){
+      found = true;
+      generation = get_uint32(block + 2);
+      tail = get_uint32(block + 6);
+      sequence = get_uint32(block + 10);
+    }
+  }
+  
+  if(found == false){
+    return false;
+  }
+  
+  _informCount = 0;
+  position = tail;
+  used = 0;
+  
+  //records continue while the sequence does and the checksums match
+  while(used + SNMP_JOURNAL_OVERHEAD <= _journal.ring_size){
+    if(journalReadRing(position, header, sizeof(header)) == false){
+      break;
+    }
+    length = ((uint16_t)header[6] << 8) | header[7];
+    if(header[0] != 'J' || get_uint32(header + 2) != sequence || length < 8 || length - 8 > SNMP_MAX_PACKET_LEN
+        || used + length + 10 > _journal.ring_size){
+      break;
+    }
+    
+    //the transmit buffer is free while nothing is being sent
+    pdu_size = length - 8;
+    if(journalReadRing((position + sizeof(header)) % _journal.ring_size, _txPacket, pdu_size) == false
+        || journalReadRing((position + sizeof(header) + pdu_size) % _journal.ring_size, trailer, sizeof(trailer)) == false){
+      break;
+    }
+    check = fletcher16(fletcher16(0, header + 1, sizeof(header) - 1), _txPacket, pdu_size);
+    if(trailer[0] != (check >> 8) || trailer[1] != (check & 0xFF)){
+      break;
+    }
+    
+    request_id = get_uint32(header + 8);
+    pending = get_uint32(header + 12);
+    
+    for(i = 0; i < _informCount && _informs[i].request_id != request_id; i++);
+    
+    if(header[1] == SNMP_JOURNAL_ENQUEUE){
+      //a checkpoint repeats informs that are already loaded
+      if(i < _informCount){
+        removeInform(i);
+      }
+      if(_informCount == SNMP_MAX_PENDING_INFORMS){
+        removeInform(0);
+      }
+      SNMP_PENDING_INFORM *inform = &_informs[_informCount++];
+      inform->request_id = request_id;
+      inform->pending = pending;
+      inform->size = pdu_size;
+      memcpy(inform->pdu, _txPacket, pdu_size);
+      next_request = request_id + 1;
+    }else if(header[1] == SNMP_JOURNAL_ACK){
+      if(i < _informCount){
+        _informs[i].pending = pending;
+        if(pending == 0){
+          removeInform(i);
+        }
+      }
+    }else{
+      break;
+    }
+    
+    position = (position + length + 10) % _journal.ring_size;
+    used += length + 10;
+    sequence++;
+  }
+  
+  _journal.generation = generation;
+  _journal.tail = tail;
+  _journal.head = position;
+  _journal.used = used;
+  _journal.sequence = sequence;
+  
+  //due at the next process_informs()
+  for(i = 0; i < _informCount; i++){
+    _informs[i].inflight = 0;
+  }
+  _nextInformCheck = millis();
+  
+  //request ids continue after the replayed ones
+  if(next_request != 0 && (int32_t)(next_request - requestCounter) > 0){
+    requestCounter = next_request;
+  }
+  
+  return true;
+}
+
+//Fletcher-16, check carries the sums from a previous call (start with 0)
+uint16_t SNMPClass::fletcher16(uint16_t check, const byte *data, uint16_t size)
+{
+  uint16_t sum1 = check & 0xFF;
+  uint16_t sum2 = check >> 8;
+  
+  for(uint16_t i = 0; i < size; i++){
+    sum1 = (sum1 + data[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  
+  return (sum2 << 8) | sum1;
+}
+
+/**
+ * Sends an external byte array as is, the packet buffers are not used.
+ * 
+ * Original Auther: Rex Park
+ * Added: November 8, 2015 (Designed to be used with a system that resends informs that haven't been acknowledged)
+ */
+void SNMPClass::send_message(IPAddress address, uint16_t port, byte *packet, uint16_t packet_size){
+  Udp.beginPacket(address, port);
+  Udp.write(packet, packet_size);
+  Udp.endPacket();
+}
+
+/**
+ * Sends the segments of the last message as one datagram.
+ *   Each segment is written from where it lives, borrowed bytes are never copied into _txPacket.
+ *
+ * Original Auther: Rex Park
+ * Updated: Writes the segment list instead of the packet buffer + extra_data
+ */
+void SNMPClass::writePacket(IPAddress address, uint16_t port)
+{
+  Udp.beginPacket(address, port);
+  
+  for(byte i = 0; i < _segmentCount; i++){
+    Udp.write(_segments[i].data, _segments[i].size);
+  }
+  
+  if(_producer != NULL){
+    writeStream();
+  }
+  
+  Udp.endPacket();
+}
+
+/**
+ * Sends the contents of a streamed value in SNMP_STREAM_CHUNK_LEN pieces.
+ *   The length was already encoded, a producer that stops early is padded with zeros.
+ *
+ * Original Auther: Rex Park
+ */
+void SNMPClass::writeStream()
+{
+  byte chunk[SNMP_STREAM_CHUNK_LEN];
+  uint16_t offset = 0;
+  uint16_t produced = 0;
+  uint16_t n;
+  boolean finished = false;
+  
+  while(offset < _streamSize){
+    n = _streamSize - offset;
+    if(n > SNMP_STREAM_CHUNK_LEN){
+      n = SNMP_STREAM_CHUNK_LEN;
+    }
+    
+    if(finished == false){
+      produced = _producer(offset, chunk, n, _producerContext);
+      
+      if(produced < n){
+        finished = true;//zeros from here on
+      }
+    }else{
+      produced = 0;
+    }
+    
+    if(produced < n){
+      memset(chunk + produced, 0, n - produced);
+    }
+    
+    Udp.write(chunk, n);
+    offset += n;
+  }
+}
+
+/**
+ * Sends the last message again, including any extra_data or borrowed value it had.
+ *   The segments recorded by send_message are resent. The extra_data argument is ignored,
+ *   it is kept so existing sketches still compile.
+ */
+void SNMPClass::resend_message(IPAddress address, uint16_t port, char *)
+{
+  //nothing left to resend after a message that didn't fit
+  if(_segmentCount == 0){
+    return;
+  }
+  
+  this->writePacket(address, port);
+}
+
+//empty segments are skipped, the list holds at most SNMP_MAX_SEGMENTS
+void SNMPClass::add_segment(const byte *data, uint16_t size)
+{
+  if(data != NULL && size > 0 && _segmentCount < SNMP_MAX_SEGMENTS){
+    _segments[_segmentCount].data = data;
+    _segments[_segmentCount].size = size;
+    _segmentCount++;
+  }
+}
+
+void SNMPClass::onPduReceive(onPduReceiveCallback pduReceived)
+{
+  _callback = pduReceived;
+}
+
+void SNMPClass::freePdu(SNMP_PDU *pdu)
+{
+  pdu->clear();
+}
+
+uint16_t SNMPClass::copy_packet(byte *packet_store){
+  memcpy(packet_store,_txPacket+_txPos,_txSize);
+
+  return _txSize;
+}
+
+void SNMPClass::clear_packet(){
+  memset(_txPacket,0,SNMP_MAX_PACKET_LEN);
+  _txSize = 0;
+  _segmentCount = 0;
+}
+
+IPAddress SNMPClass::remoteIP(){
+  return Udp.remoteIP();
+}
+
+uint16_t SNMPClass::remotePort(){
+  return Udp.remotePort();
 }
 
 //returns the first byte of a two byte integer
@@ -24,23 +24,190 @@
 #define SNMP_DEFAULT_PORT	161
 #define SNMP_MANAGER_PORT	162
 #define SNMP_MIN_OID_LEN	2
-#define SNMP_MAX_OID_LEN	64 // 128
-#define SNMP_MAX_NAME_LEN	20
-#define SNMP_MAX_VALUE_LEN      256
-#define SNMP_MAX_PACKET_LEN     SNMP_MAX_VALUE_LEN + SNMP_MAX_OID_LEN + 25 //25 is arbitrary
+
+// Sizing
+//   Every SNMP_VALUE, SNMP_OID and the packet buffer are sized from these. Any of them can be set
+//   with a build flag (e.g. -DSNMP_MAX_VALUE_LEN=64), or pick a profile with -DSNMP_PROFILE_TINY
+//   or -DSNMP_PROFILE_GATEWAY. The sketch and the library have to be built with the same values.
+#if defined(SNMP_PROFILE_TINY)
+  //small sensor nodes (ATmega328), short OIDs and values only
+  #ifndef SNMP_MAX_OID_LEN
+    #define SNMP_MAX_OID_LEN	16
+  #endif
+  #ifndef SNMP_MAX_NAME_LEN
+    #define SNMP_MAX_NAME_LEN	12
+  #endif
+  #ifndef SNMP_MAX_VALUE_LEN
+    #define SNMP_MAX_VALUE_LEN	64
+  #endif
+  #ifndef SNMP_MAX_PACKET_LEN
+    #define SNMP_MAX_PACKET_LEN	128
+  #endif
+  #ifndef SNMP_SCRATCH_LEN
+    #define SNMP_SCRATCH_LEN	32
+  #endif
+  #ifndef SNMP_TEMPLATE_LEN
+    #define SNMP_TEMPLATE_LEN	40
+  #endif
+  #ifndef SNMP_TEMPLATE_MAX_OBJECTS
+    #define SNMP_TEMPLATE_MAX_OBJECTS	2
+  #endif
+  #ifndef SNMP_MAX_TARGETS
+    #define SNMP_MAX_TARGETS	1
+  #endif
+  #ifndef SNMP_MAX_PENDING_INFORMS
+    #define SNMP_MAX_PENDING_INFORMS	1
+  #endif
+  #ifndef SNMP_JOURNAL_BUFFER_LEN
+    #define SNMP_JOURNAL_BUFFER_LEN	32
+  #endif
+  #ifndef SNMP_MAX_FILTERS
+    #define SNMP_MAX_FILTERS	2
+  #endif
+  #ifndef SNMP_FILTER_LEN
+    #define SNMP_FILTER_LEN	16
+  #endif
+#elif defined(SNMP_PROFILE_GATEWAY)
+  //hosts with plenty of memory, largest UDP payload
+  #ifndef SNMP_MAX_OID_LEN
+    #define SNMP_MAX_OID_LEN	128
+  #endif
+  #ifndef SNMP_MAX_NAME_LEN
+    #define SNMP_MAX_NAME_LEN	64
+  #endif
+  #ifndef SNMP_MAX_VALUE_LEN
+    #define SNMP_MAX_VALUE_LEN	32768
+  #endif
+  #ifndef SNMP_MAX_PACKET_LEN
+    #define SNMP_MAX_PACKET_LEN	65507
+  #endif
+  #ifndef SNMP_SCRATCH_LEN
+    #define SNMP_SCRATCH_LEN	4096
+  #endif
+  #ifndef SNMP_TEMPLATE_LEN
+    #define SNMP_TEMPLATE_LEN	512
+  #endif
+  #ifndef SNMP_TEMPLATE_MAX_OBJECTS
+    #define SNMP_TEMPLATE_MAX_OBJECTS	16
+  #endif
+  #ifndef SNMP_MAX_TARGETS
+    #define SNMP_MAX_TARGETS	16
+  #endif
+  #ifndef SNMP_MAX_PENDING_INFORMS
+    #define SNMP_MAX_PENDING_INFORMS	32
+  #endif
+  #ifndef SNMP_JOURNAL_BUFFER_LEN
+    #define SNMP_JOURNAL_BUFFER_LEN	4096
+  #endif
+  #ifndef SNMP_INFORM_WINDOW
+    #define SNMP_INFORM_WINDOW	8
+  #endif
+  #ifndef SNMP_MAX_FILTERS
+    #define SNMP_MAX_FILTERS	64
+  #endif
+  #ifndef SNMP_FILTER_LEN
+    #define SNMP_FILTER_LEN	1024
+  #endif
+#endif
+
+#ifndef SNMP_MAX_OID_LEN
+  #define SNMP_MAX_OID_LEN	64 // 128
+#endif
+#ifndef SNMP_MAX_NAME_LEN
+  #define SNMP_MAX_NAME_LEN	20
+#endif
+#ifndef SNMP_MAX_VALUE_LEN
+  #define SNMP_MAX_VALUE_LEN      256
+#endif
+#ifndef SNMP_MAX_PACKET_LEN
+  #define SNMP_MAX_PACKET_LEN     (SNMP_MAX_VALUE_LEN + SNMP_MAX_OID_LEN + 25) //25 is arbitrary
+#endif
+#ifndef SNMP_SCRATCH_LEN
+  #define SNMP_SCRATCH_LEN        64 //per request scratch memory, see SNMPClass::scratch
+#endif
+#ifndef SNMP_STREAM_CHUNK_LEN
+  #define SNMP_STREAM_CHUNK_LEN   64 //stack buffer used while sending streamed values
+#endif
+#ifndef SNMP_TEMPLATE_LEN
+  #define SNMP_TEMPLATE_LEN       48 //pre-encoded OIDs of one notification template, see SNMP_NOTIFICATION_TEMPLATE
+#endif
+#ifndef SNMP_TEMPLATE_MAX_OBJECTS
+  #define SNMP_TEMPLATE_MAX_OBJECTS 4
+#endif
+#ifndef SNMP_MAX_TARGETS
+  #define SNMP_MAX_TARGETS        2 //notification destinations, see SNMPClass::set_target
+#endif
+#ifndef SNMP_MAX_PENDING_INFORMS
+  #define SNMP_MAX_PENDING_INFORMS 3 //informs kept for resending until every target acknowledged them
+#endif
+#ifndef SNMP_JOURNAL_BUFFER_LEN
+  #define SNMP_JOURNAL_BUFFER_LEN 128 //journal records collected in RAM before they are written to storage
+#endif
+#ifndef SNMP_JOURNAL_FLUSH_MS
+  #define SNMP_JOURNAL_FLUSH_MS   250 //longest a journal record waits in RAM
+#endif
+#ifndef SNMP_INFORM_WINDOW
+  #define SNMP_INFORM_WINDOW      2 //informs sent to a target and not yet acknowledged, the rest wait in the table
+#endif
+#ifndef SNMP_INFORM_RETRIES
+  #define SNMP_INFORM_RETRIES     5 //resends before a target is given up on for an inform
+#endif
+#ifndef SNMP_INFORM_BACKOFF_STEPS
+  #define SNMP_INFORM_BACKOFF_STEPS 5 //the resend interval doubles this many times at most
+#endif
+#ifndef SNMP_MAX_FILTERS
+  #define SNMP_MAX_FILTERS        8 //notification filter subtrees, shared by all targets, see SNMPClass::add_filter
+#endif
+#ifndef SNMP_FILTER_LEN
+  #define SNMP_FILTER_LEN         64 //bytes for the encoded filter subtrees
+#endif
+#define SNMP_MAX_SEGMENTS       4  //encoded packet, extra_data, borrowed value. v1 translation: header + up to 3 runs of varbinds
+#define SNMP_TRAP1_HEADER_LEN   (48 + SNMP_MAX_NAME_LEN + 2*SNMP_MAX_OID_LEN) //stack buffer for the v1 trap fields in front of translated varbinds
+#define SNMP_JOURNAL_SUPERBLOCK_LEN 16
+#define SNMP_JOURNAL_OVERHEAD   18 //'J', type, sequence, length, request id, pending, checksum
+//storage attach_journal needs: two superblocks, two full inform tables and one more record
+#define SNMP_JOURNAL_MIN_SIZE   (2 * SNMP_JOURNAL_SUPERBLOCK_LEN + (2 * (uint32_t)SNMP_MAX_PENDING_INFORMS + 1) * (SNMP_JOURNAL_OVERHEAD + SNMP_MAX_PACKET_LEN))
+
+#if SNMP_MAX_PACKET_LEN > 65535 || SNMP_MAX_VALUE_LEN > 65535
+  #error "ArduinoSNMP: packet and value lengths are 16-bit"
+#endif
+#if SNMP_MAX_TARGETS < 1 || SNMP_MAX_TARGETS > 32
+  #error "ArduinoSNMP: SNMP_MAX_TARGETS must be between 1 and 32"
+#endif
+#if SNMP_MAX_OID_LEN < SNMP_MIN_OID_LEN || SNMP_MAX_OID_LEN > 255
+  #error "ArduinoSNMP: SNMP_MAX_OID_LEN must be between SNMP_MIN_OID_LEN and 255"
+#endif
+// SNMP_NO_HEAP: the library never allocates, with this defined malloc/free are poisoned in its
+// translation units (and in the example agent's) so that stays true. Memory is all static,
+// sizeof(SNMPClass) is what the library costs, add -DSNMP_RAM_BUDGET=n to fail the build above n bytes.
+#ifndef SNMP_NO_HEAP
 #define SNMP_FREE(s)   do { if (s) { free((void *)s); s=NULL; } } while(0)
 //Frees a pointer only if it is !NULL and sets its value to NULL. 
+#endif
 
+// SNMP_HOST: only the BER, OID, value and PDU types, for tools that run on a host (see Example/snmp_trap_receiver).
+// SNMPClass needs the Arduino networking stack and is left out.
+#ifdef SNMP_HOST
+#include "SNMPHost.h"
+#else
 #include "Arduino.h"
 #include "Udp.h"
+#endif
 
 extern "C" {
   // callback function
   typedef void (*onPduReceiveCallback)(void);
+  
+  // fills chunk with up to max_size bytes of a streamed value starting at offset, returns the number of bytes written
+  typedef uint16_t (*valueProducerCallback)(uint32_t offset, byte *chunk, uint16_t max_size, void *context);
+  
+  // inform journal storage (see SNMPClass::attach_journal), return false if the bytes could not be read or written
+  typedef boolean (*journalReadCallback)(uint32_t address, byte *data, uint16_t size, void *context);
+  typedef boolean (*journalWriteCallback)(uint32_t address, const byte *data, uint16_t size, void *context);
 }
 
 //typedef long long int64_t;
-typedef unsigned long long uint64_t;
+//typedef unsigned long long uint64_t;
 //typedef long int32_t;
 //typedef unsigned long uint32_t;
 //typedef unsigned char uint8_t;
@@ -170,8 +337,289 @@ typedef enum SNMP_SYNTAXES {
   SNMP_SYNTAX_UINT32 	       = ASN_BER_BASE_APPLICATION | ASN_BER_BASE_PRIMITIVE | 7,
 };
 
+/**
+ * Builds BER from the end of a buffer towards the start.
+ *   Contents are written before the tag and length that precede them, so the length of a
+ *   sequence is known when its header is written and nothing is patched or copied afterwards.
+ *   Usage: m = mark(), write the contents (last item first), close(tag, m).
+ *   Writes that do not fit set overflow and are dropped, the buffer is never overrun.
+ *
+ * Original Author: Rex Park
+ */
+typedef struct SNMP_BER_WRITER {
+  byte *buffer;
+  uint16_t capacity;
+  uint16_t position;//index of the first written byte
+  uint16_t length;//bytes written, including trailing bytes sent after the buffer
+  boolean overflow;
+
+  void begin(byte *b, uint16_t c){
+    buffer = b;
+    capacity = c;
+    position = c;
+    length = 0;
+    overflow = false;
+  }
+
+  /**
+   * Counts bytes that are sent after the buffer contents (see send_message extra_data)
+   * in the length of every sequence that is open at this point.
+   */
+  void trailing(uint16_t size){
+    length += size;
+  }
+
+  uint16_t mark() const {
+    return length;
+  }
+
+  boolean reserve(uint16_t size){
+    if(overflow == true || size > position){
+      overflow = true;
+      return false;
+    }
+    position -= size;
+    length += size;
+    return true;
+  }
+
+  void push(byte b){
+    if(reserve(1)){
+      buffer[position] = b;
+    }
+  }
+
+  void push(const byte *data, uint16_t size){
+    if(size > 0 && reserve(size)){
+      memcpy(buffer + position, data, size);
+    }
+  }
+
+  //shortest legal length: short form below 128, then 0x81 and 0x82 forms
+  void push_length(uint16_t size){
+    if(size < 0x80){
+      push(size);
+    }else if(size <= 0xFF){
+      push(size);
+      push(0x81);
+    }else{
+      push(size & 0xFF);
+      push(size >> 8);
+      push(0x82);
+    }
+  }
+
+  void push_header(byte tag, uint16_t size){
+    push_length(size);
+    push(tag);
+  }
+
+  //wraps everything written since m in tag + length
+  void close(byte tag, uint16_t m){
+    push_header(tag, length - m);
+  }
+
+  //INTEGER in the fewest two's complement octets, independent of host byte order
+  void push_integer(byte tag, int32_t value){
+    byte n = integer_size(value);
+    for(byte i = 0; i < n; i++){
+      push((value >> (8*i)) & 0xFF);
+    }
+    push_header(tag, n);
+  }
+
+  //Counter32, Gauge32, TimeTicks, Unsigned32: a leading zero is added when the high bit is set
+  void push_unsigned(byte tag, uint32_t value){
+    byte n = unsigned_size(value);
+    for(byte i = 0; i < n && i < 4; i++){
+      push((value >> (8*i)) & 0xFF);
+    }
+    if(n == 5){
+      push(0);
+    }
+    push_header(tag, n);
+  }
+
+  //Counter64, kept apart from push_unsigned so 32-bit values never pay for 64-bit shifts
+  void push_unsigned64(byte tag, uint64_t value){
+    byte n = unsigned64_size(value);
+    for(byte i = 0; i < n && i < 8; i++){
+      push((value >> (8*i)) & 0xFF);
+    }
+    if(n == 9){
+      push(0);
+    }
+    push_header(tag, n);
+  }
+
+  //
+  // Forward encoding helpers, used where values are appended to a buffer (SNMP_VALUE, add_data)
+  //
+
+  static byte length_size(uint16_t size){
+    return size < 0x80 ? 1 : (size <= 0xFF ? 2 : 3);
+  }
+
+  static byte integer_size(int32_t value){
+    byte n = 1;
+    while(n < 4 && (value < -(1L << (8*n-1)) || value >= (1L << (8*n-1)))){
+      n++;
+    }
+    return n;
+  }
+
+  static byte unsigned_size(uint32_t value){
+    byte n = 1;
+    while(n < 5 && value >= (1UL << (8*n-1))){
+      n++;
+    }
+    return n;
+  }
+
+  static byte unsigned64_size(uint64_t value){
+    if(value <= 0xFFFFFFFFULL){
+      return unsigned_size((uint32_t)value);
+    }
+    byte n = 5;
+    while(n < 9 && value >= (1ULL << (8*n-1))){
+      n++;
+    }
+    return n;
+  }
+
+  //writes tag + length at buffer, returns the number of bytes written
+  static byte put_header(byte *buffer, byte tag, uint16_t size){
+    buffer[0] = tag;
+    if(size < 0x80){
+      buffer[1] = size;
+      return 2;
+    }else if(size <= 0xFF){
+      buffer[1] = 0x81;
+      buffer[2] = size;
+      return 3;
+    }
+    buffer[1] = 0x82;
+    buffer[2] = size >> 8;
+    buffer[3] = size & 0xFF;
+    return 4;
+  }
+
+  static byte put_integer(byte *buffer, byte tag, int32_t value){
+    byte n = integer_size(value);
+    byte h = put_header(buffer, tag, n);
+    for(byte i = 0; i < n; i++){
+      buffer[h + i] = (value >> (8*(n-1-i))) & 0xFF;
+    }
+    return h + n;
+  }
+
+  static byte put_unsigned(byte *buffer, byte tag, uint32_t value){
+    byte n = unsigned_size(value);
+    byte h = put_header(buffer, tag, n);
+    if(n == 5){
+      buffer[h++] = 0;
+      n = 4;
+    }
+    for(byte i = 0; i < n; i++){
+      buffer[h + i] = (value >> (8*(n-1-i))) & 0xFF;
+    }
+    return h + n;
+  }
+
+  static byte put_unsigned64(byte *buffer, byte tag, uint64_t value){
+    byte n = unsigned64_size(value);
+    byte h = put_header(buffer, tag, n);
+    if(n == 9){
+      buffer[h++] = 0;
+      n = 8;
+    }
+    for(byte i = 0; i < n; i++){
+      buffer[h + i] = (value >> (8*(n-1-i))) & 0xFF;
+    }
+    return h + n;
+  }
+
+  byte *data(){
+    return buffer + position;
+  }
+
+  const byte *data() const {
+    return buffer + position;
+  }
+
+  //bytes in the buffer, trailing bytes not included
+  uint16_t size() const {
+    return capacity - position;
+  }
+};
+
+/**
+ * One piece of an outgoing datagram. The bytes are borrowed, they must stay valid until the message
+ * has been sent (and resent, see resend_message).
+ *
+ * Original Author: Rex Park
+ */
+typedef struct SNMP_IOVEC {
+  const byte *data;
+  uint16_t size;
+};
+
+/**
+ * Bump allocator for per request scratch memory.
+ *   Allocations are 4 byte aligned and are never freed one by one, reset() releases all of them at once.
+ *   high_water is the most that was in use at any time, use it to size SNMP_SCRATCH_LEN.
+ *
+ * Original Author: Rex Park
+ */
+typedef struct SNMP_ARENA {
+  uint32_t buffer[(SNMP_SCRATCH_LEN + 3) / 4];
+  uint16_t used;
+  uint16_t high_water;
+  uint16_t failed;//allocations that didn't fit
+  
+  void *alloc(uint16_t size){
+    size = (size + 3) & ~3;
+    
+    if(size > sizeof(buffer) - used){
+      failed++;
+      return NULL;
+    }
+    
+    void *p = (byte*)buffer + used;
+    used += size;
+    if(used > high_water){
+      high_water = used;
+    }
+    return p;
+  }
+  
+  void reset(){
+    used = 0;
+  }
+};
+
+/**
+ * Read only view of encoded bytes (no syntax or length) inside another buffer.
+ * Used to look at parts of a received packet without copying them out.
+ *
+ * Original Author: Rex Park
+ */
+typedef struct SNMP_BER_VIEW {
+  const byte *data;
+  uint16_t size;
+
+  boolean equals(const byte *encoded, uint16_t length) const {
+    return data != NULL && size == length && memcmp(data, encoded, length) == 0;
+  }
+
+  //true if the view begins with encoded, for OIDs this is a subtree match
+  boolean startsWith(const byte *encoded, uint16_t length) const {
+    return data != NULL && size >= length && memcmp(data, encoded, length) == 0;
+  }
+};
+
 typedef struct SNMP_OID {
-  unsigned int data[SNMP_MAX_OID_LEN];  // ushort array insted??
+  uint32_t data[SNMP_MAX_OID_LEN];  // arcs are unsigned 32-bit (RFC 2578)
   size_t size;
   
   /**
@@ -200,8 +648,8 @@ typedef struct SNMP_OID {
     size = 2;
     value_index = 1;
     
-    unsigned int n = 0;
-    for(value_index; value_index < length; value_index++){
+    uint32_t n = 0;
+    for(; value_index < length; value_index++){
       n = (n << 7) + (value[value_index] & 0x7f);
       if(value[value_index] < 0x80){
         data[size++] = n;
@@ -219,76 +667,145 @@ typedef struct SNMP_OID {
   /**
    * Prepares an OID for tranmission.
    *   Sets the syntax value, encoded data length, and encodes the OID itself.
-   * Assumes that size has been set and is accurate.
+   * Assumes that size has been set and is accurate. size is not modified.
    * Encoding algorithm is based on encode_object_id from https://github.com/hallidave/ruby-snmp/blob/master/lib/snmp/ber.rb
    *
    * Returns the number of bytes modified in the buffer.
    *
    * Original Author: Rex Park
    * Updated: March 29, 2013
+   * Updated: Shortest length form, first sub-identifier is base 128 like every other arc
    */
-  byte encode(byte *buffer) {
-    byte buffer_index = 2;
+  uint16_t encode(byte *buffer) const {
+    if(size > 1 && data[0] < 2 && data[1] > 40){ return 0; }//invalid, get out of here
+    
+    uint16_t length = encoded_length();
+    uint16_t buffer_index = SNMP_BER_WRITER::put_header(buffer, SNMP_SYNTAX_OID, length);
     
     if(size > 1){
-      if(data[0] < 2 && data[1] > 40){ return 0; }//invalid, get out of here
-      
-      buffer[0] = SNMP_SYNTAX_OID;
-      
-      buffer[buffer_index++] = 40*data[0]+data[1];//first encoded byte is a combination of first two OID values.
+      buffer_index += put_arc(buffer + buffer_index, 40*data[0]+data[1]);//first encoded value is a combination of first two OID values.
       
       //loop through rest of OID
       for(byte i = 2; i < size; i++){
-        if(data[i] < 0x80){
-          buffer[buffer_index++] = data[i];
-        }else{
-          unsigned int n = data[i];
-          byte octets[10];
-          byte octet_index = 9;
-          
-          while(n != 0){
-            octets[octet_index--] = (n & 0x7f | 0x80);
-            n = n >> 7;
-          }
-          octets[9] = (octets[9] & 0x7f);
-          octet_index++;//counteract the last decrementer
-
-          while(octet_index < 10){
-            buffer[buffer_index++] = octets[octet_index++];
-          }
-        }
+        buffer_index += put_arc(buffer + buffer_index, data[i]);
       }
     }
     else if (size == 1) {
-      buffer[buffer_index++] = (40*data[0]);
+      buffer_index += put_arc(buffer + buffer_index, 40*data[0]);
     }
-    
-    buffer[1] = buffer_index-2;//length of encoded OID
-    size = buffer_index;
 
     return buffer_index;
   }
   
+  //bytes needed for the encoded arcs, syntax and length not included
+  uint16_t encoded_length() const {
+    uint16_t length = 0;
+    
+    if(size > 1){
+      length = arc_size(40*data[0]+data[1]);
+      for(size_t i = 2; i < size; i++){
+        length += arc_size(data[i]);
+      }
+    }else if(size == 1){
+      length = arc_size(40*data[0]);
+    }
+    
+    return length;
+  }
+  
+  static byte arc_size(uint32_t n){
+    byte count = 1;
+    while(n >= 0x80){
+      n >>= 7;
+      count++;
+    }
+    return count;
+  }
+  
+  //base 128, high bit set on every octet but the last
+  static byte put_arc(byte *buffer, uint32_t n){
+    byte count = arc_size(n);
+    for(byte i = count; i > 0; i--){
+      buffer[i-1] = (n & 0x7f) | (i == count ? 0 : 0x80);
+      n >>= 7;
+    }
+    return count;
+  }
+  
+  /**
+   * Encodes the OID (syntax, length and arcs) into a writer, last arc first.
+   *   Returns the number of bytes written.
+   *
+   * Original Author: Rex Park
+   */
+  uint16_t encode(SNMP_BER_WRITER *writer) const {
+    uint16_t m = writer->mark();
+    
+    if(size > 1){
+      for(size_t i = size-1; i >= 2; i--){
+        push_arc(writer, data[i]);
+      }
+      push_arc(writer, 40*data[0]+data[1]);//first encoded value is a combination of first two OID values.
+    }
+    else if(size == 1){
+      push_arc(writer, 40*data[0]);
+    }
+    
+    writer->push_header(SNMP_SYNTAX_OID, writer->mark() - m);
+    
+    return writer->mark() - m;
+  }
+  
+  //base 128, high bit set on every octet but the last
+  static void push_arc(SNMP_BER_WRITER *writer, uint32_t n){
+    writer->push(n & 0x7f);
+    n >>= 7;
+    while(n != 0){
+      writer->push((n & 0x7f) | 0x80);
+      n >>= 7;
+    }
+  }
+  
   /**
    * Parses OID byte data from char string.
+   *   Accepts full 32-bit arcs and an optional leading dot (".1.3.6.1").
+   *   Returns the number of arcs parsed, 0 (and an empty OID) if the string is not a valid OID,
+   *   has an arc above 4294967295 or has more than SNMP_MAX_OID_LEN arcs.
    *
    * Original Author: Agentuino Project
    * Updated: Rex Park, April 4, 2013 (re-wrote integer parsing)
+   * Updated: Single pass parser, no temporary buffer, atoi or delay()
    */
   byte fromString(const char *buffer){
     clear();
     
-    byte b_size = strlen(buffer);
-    byte n = 0;
-    for(byte i = 0; i <= b_size; i++){
-      char t[6];
-      if(buffer[i] == '.' || n == 5 || buffer[i] == '\0'){
-        t[n] = '\0';
-        data[size++] = atoi(t);
-        n = 0;
-      }else if(n < 5){
-        t[n++] = buffer[i];
-        delay(10);//Delay needed to function on Due
+    if(*buffer == '.'){ buffer++; }
+    
+    while(*buffer != '\0'){
+      if(*buffer < '0' || *buffer > '9' || size >= SNMP_MAX_OID_LEN){
+        clear();
+        return 0;
+      }
+      
+      uint32_t n = 0;
+      while(*buffer >= '0' && *buffer <= '9'){
+        byte digit = *buffer++ - '0';
+        
+        //n * 10 + digit must stay below 2^32
+        if(n > 429496729UL || (n == 429496729UL && digit > 5)){
+          clear();
+          return 0;
+        }
+        n = n * 10 + digit;
+      }
+      data[size++] = n;
+      
+      if(*buffer == '.'){
+        buffer++;
+        if(*buffer == '\0'){ clear(); return 0; }//trailing dot
+      }else if(*buffer != '\0'){
+        clear();
+        return 0;
       }
     }
     
@@ -316,36 +833,125 @@ typedef struct SNMP_OID {
   
   /**
    * Copies OID data into a char buffer using dot notation.
+   *   Written in a single pass, arcs that do not fit in buffer_length (including the null) are dropped.
+   *   Returns the length of the string.
    *
    * Original Author: Agentuino Project
    * Updated: Rex Park, April 2, 2013 (simplified process and removed hard coded 1.3 data)
+   * Updated: Formats each arc in place instead of utoa/strlen/strcat per arc
    */
-  void toString(char *buffer, byte buffer_length) {
-    if(size <= 0){
-      buffer[0] = '\0';
+  uint16_t toString(char *buffer, uint16_t buffer_length) {
+    uint16_t position = 0;
+    
+    if(buffer_length == 0){ return 0; }
+    
+    for(size_t i = 0; i < size; i++){
+      char digits[10];
+      byte count = 0;
+      uint32_t n = data[i];
       
-      return;
-    }
-
-    char buff[16];
-    for(byte i = 0; i < size; i++){
-      utoa(data[i], buff, 10);
+      do{
+        digits[count++] = '0' + (n % 10);
+        n /= 10;
+      }while(n != 0);
+      
+      //separator + digits + null terminator
+      if(position + (i != 0) + count + 1 > buffer_length){
+        break;
+      }
       
-      if(strlen(buffer) + strlen(buff) + 1 < buffer_length){
-        if(i != 0){
-          strcat_P(buffer, PSTR("."));
+      if(i != 0){
+        buffer[position++] = '.';
+      }
+      while(count > 0){
+        buffer[position++] = digits[--count];
+      }
+    }
+    
+    buffer[position] = '\0';
+    return position;
+  }
+  
+  /**
+   * Orders two OIDs arc by arc (the order used by GetNext).
+   *   Returns -1, 0 or 1.
+   *
+   * Original Author: Rex Park
+   */
+  int8_t compare(const SNMP_OID &other) const {
+    size_t length = size < other.size ? size : other.size;
+    
+    for(size_t i = 0; i < length; i++){
+      if(data[i] != other.data[i]){
+        return data[i] < other.data[i] ? -1 : 1;
+      }
+    }
+    
+    if(size == other.size){ return 0; }
+    return size < other.size ? -1 : 1;
+  }
+  
+  boolean equals(const SNMP_OID &other) const {
+    return size == other.size && memcmp(data, other.data, size * sizeof(data[0])) == 0;
+  }
+  
+  //true if this OID is prefix or is in the subtree below prefix
+  boolean startsWith(const SNMP_OID &prefix) const {
+    return prefix.size <= size && memcmp(data, prefix.data, prefix.size * sizeof(data[0])) == 0;
+  }
+  
+  /**
+   * Compares the arcs against an OID in dot notation, one pass over the string and no buffers.
+   *   Returns the number of leading arcs that matched, -1 as soon as an arc differs,
+   *   doesn't fit in 32 bits or the string has more arcs than this OID.
+   *
+   * Original Author: Rex Park
+   */
+  int16_t match(const char *oid) const {
+    size_t arc = 0;
+    
+    while(*oid != '\0'){
+      uint32_t n = 0;
+      while(*oid >= '0' && *oid <= '9'){
+        byte digit = *oid++ - '0';
+        
+        //same limit as fromString, an arc that wrapped could match a different one
+        if(n > 429496729UL || (n == 429496729UL && digit > 5)){
+          return -1;
         }
-        strcat(buffer, buff);
-      }else{
-        i = size;
+        n = n * 10 + digit;
+      }
+      
+      if(arc >= size || data[arc] != n){ return -1; }
+      arc++;
+      
+      if(*oid == '.'){
+        oid++;
+      }else if(*oid != '\0'){
+        return -1;//not dot notation
       }
     }
     
-    buffer[buffer_length-1] = '\0';//make sure last byte is a null character
+    return arc;
+  }
+  
+  boolean equals(const char *oid) const {
+    return match(oid) == (int16_t)size;
+  }
+  
+  boolean startsWith(const char *oid) const {
+    return match(oid) >= 0;
   }
   
+  bool operator==(const SNMP_OID &other) const { return equals(other); }
+  bool operator!=(const SNMP_OID &other) const { return !equals(other); }
+  bool operator<(const SNMP_OID &other) const { return compare(other) < 0; }
+  bool operator>(const SNMP_OID &other) const { return compare(other) > 0; }
+  bool operator<=(const SNMP_OID &other) const { return compare(other) <= 0; }
+  bool operator>=(const SNMP_OID &other) const { return compare(other) >= 0; }
+  
+  //arcs past size are never read, only the size needs resetting
   void clear(void) {
-    memset(data, 0, SNMP_MAX_OID_LEN);
     size = 0;
   }
 };
@@ -358,12 +964,60 @@ typedef struct SNMP_OID {
  * Original Author: Agentuino Project
  * Updated: Rex Park, April 3, 2013 (added comments)
  */
+/**
+ * Typed values for SNMP_VALUE::set and SNMP_VALUE::get.
+ *   The BER tag is part of the type, so the encoder is picked at compile time and a value
+ *   can't be sent with the wrong syntax by accident, e.g. value.set(SNMP_TIME_TICKS(SNMP.uptime())).
+ *
+ * Original Author: Rex Park
+ */
+template<byte TAG> struct SNMP_UNSIGNED {
+  uint32_t value;
+  explicit SNMP_UNSIGNED(uint32_t v = 0) : value(v) {}
+};
+
+typedef SNMP_UNSIGNED<SNMP_SYNTAX_COUNTER> SNMP_COUNTER32;
+typedef SNMP_UNSIGNED<SNMP_SYNTAX_GAUGE> SNMP_GAUGE32;
+typedef SNMP_UNSIGNED<SNMP_SYNTAX_TIME_TICKS> SNMP_TIME_TICKS;
+typedef SNMP_UNSIGNED<SNMP_SYNTAX_UINT32> SNMP_UNSIGNED32;
+
+struct SNMP_INTEGER32 {
+  int32_t value;
+  explicit SNMP_INTEGER32(int32_t v = 0) : value(v) {}
+};
+
+struct SNMP_COUNTER64 {
+  uint64_t value;
+  explicit SNMP_COUNTER64(uint64_t v = 0) : value(v) {}
+};
+
+struct SNMP_IP_ADDRESS {
+  IPAddress value;
+  SNMP_IP_ADDRESS() : value(0,0,0,0) {}
+  explicit SNMP_IP_ADDRESS(const IPAddress &v) : value(v) {}
+};
+
+//does not own its bytes, get() points it at the value's data
+struct SNMP_OCTET_STRING {
+  const byte *data;
+  uint16_t size;
+  SNMP_OCTET_STRING() : data(NULL), size(0) {}
+  explicit SNMP_OCTET_STRING(const char *s) : data((const byte*)s), size(strlen(s)) {}
+  SNMP_OCTET_STRING(const byte *d, uint16_t length) : data(d), size(length) {}
+};
+
 typedef struct SNMP_VALUE {
   byte data[SNMP_MAX_VALUE_LEN];
   size_t size;
   SNMP_SYNTAXES syntax;
   SNMP_OID OID;
   
+  // streamed and borrowed values, see stream() and borrow()
+  valueProducerCallback producer;
+  void *producer_context;
+  const byte *borrowed;
+  uint16_t stream_size;
+  
   uint16_t i; // for encoding/decoding functions
 
   //
@@ -406,15 +1060,9 @@ typedef struct SNMP_VALUE {
    * Updated: November 18, 2015 (Fixed negative value decoding)
    */
   SNMP_ERR_CODES decode(int16_t *value) {
-    Serial.println("I'm Here");
     if ( syntax == SNMP_SYNTAX_INT ) {
-      memset(value, 0, sizeof(*value));
-      byte temp = (1 << 7) & data[0];
-      
-      if(temp != 0){
-        *value = 0xFF;
-      }
-      
+      //negative values may be sent in fewer than two octets, sign extend
+      *value = (size > 0 && (data[0] & 0x80) != 0) ? -1 : 0;
       for(i = 0;i < size;i++)
       {
         *value = *value<<8 | data[i];
@@ -461,7 +1109,8 @@ typedef struct SNMP_VALUE {
    */
   SNMP_ERR_CODES decode(int32_t *value) {
     if ( syntax == SNMP_SYNTAX_INT32 ) {
-      memset(value, 0, sizeof(*value));
+      //negative values may be sent in fewer than four octets, sign extend
+      *value = (size > 0 && (data[0] & 0x80) != 0) ? -1 : 0;
       for(i = 0;i < size;i++)
       {
         *value = *value<<8 | data[i];
@@ -497,6 +1146,32 @@ typedef struct SNMP_VALUE {
     }
   }
 
+  /**
+   * Decodes ASN Data Types: counter64, uint32, counter, time-ticks, guage
+   *   to uint64
+   *
+   * Returns SNMP_ERR_WRONG_LENGTH if the value does not fit in 64 bits (more than 8 octets after a leading zero).
+   *
+   * Original Author: Rex Park
+   */
+  SNMP_ERR_CODES decode(uint64_t *value) {
+    if ( syntax == SNMP_SYNTAX_COUNTER64 || syntax == SNMP_SYNTAX_COUNTER || syntax == SNMP_SYNTAX_TIME_TICKS
+      || syntax == SNMP_SYNTAX_GAUGE || syntax == SNMP_SYNTAX_UINT32 ) {
+      if(size > 9 || (size == 9 && data[0] != 0)){
+        return SNMP_ERR_WRONG_LENGTH;
+      }
+      *value = 0;
+      for(i = 0;i < size;i++)
+      {
+        *value = *value<<8 | data[i];
+      }
+      return SNMP_ERR_NO_ERROR;
+    } else {
+      clear();
+      return SNMP_ERR_WRONG_TYPE;
+    }
+  }
+
   /**
    * Decodes ASN Data Types: ip-address, nsap-address
    *   to byte array
@@ -547,6 +1222,7 @@ typedef struct SNMP_VALUE {
    * Updated: Rex Park, April 1, 2013 (added the ability to specify a buffer, added syntax and length)
    * Updated: Rex Park, November 14, 2013 (modified length to long-form)
    * Updated Rex Park, November 15, 2013 (modified to not add data to buffer, allows sending data that has its own buffer.)
+   * Updated: Shortest length form
    */
   SNMP_ERR_CODES encode(SNMP_SYNTAXES syn, const char *value, byte *buffer=NULL, boolean ignore_data = false) {
     if(buffer == NULL){
@@ -555,21 +1231,16 @@ typedef struct SNMP_VALUE {
     }
     
     if ( syn == SNMP_SYNTAX_OCTETS || syn == SNMP_SYNTAX_OPAQUE ) {
-      if ( strlen(value) - 1 < SNMP_MAX_VALUE_LEN || ignore_data == true) {
-         size = strlen(value);
-        
-         buffer[0] = syn;//syntax
-         buffer[1] = 0x82;
-         buffer[2] = msb(size);
-         buffer[3] = lsb(size);
-         size += 4;//add in syntax & length bytes
+      size_t length = strlen(value);
+      
+      if ( length + 4 <= SNMP_MAX_VALUE_LEN || ignore_data == true) {
+        i = SNMP_BER_WRITER::put_header(buffer, syn, length);//syntax & length bytes
         
         if(ignore_data == false){
-          for ( i = 4; i < size; i++ ) {
-            buffer[i] = (byte)value[i-4];
-          }
+          memcpy(buffer + i, value, length);
+          size = i + length;
         }else{
-          size = 4;
+          size = i;
         }
 
         syntax = syn;
@@ -591,25 +1262,17 @@ typedef struct SNMP_VALUE {
    * Original Author: Agentuino Project
    * Updated Rex Park, January 08, 2014 (Created based off char array encoder.)
    */
-  SNMP_ERR_CODES encode(SNMP_SYNTAXES syn, byte *value, byte length, byte *buffer=NULL) {
+  SNMP_ERR_CODES encode(SNMP_SYNTAXES syn, byte *value, uint16_t length, byte *buffer=NULL) {
     if(buffer == NULL){
       clear();
       buffer = data;
     }
     
     if ( syn == SNMP_SYNTAX_OCTETS || syn == SNMP_SYNTAX_OPAQUE ) {
-      if ( length < SNMP_MAX_VALUE_LEN) {
-        size = length;
-        
-        buffer[0] = syn;//syntax
-        buffer[1] = 0x82;
-        buffer[2] = msb(size);
-        buffer[3] = lsb(size);
-        size += 4;//add in syntax & length bytes
-        
-        for ( i = 4; i < size; i++ ) {
-          buffer[i] = value[i-4];
-        }
+      if ( length + 4 <= SNMP_MAX_VALUE_LEN) {
+        i = SNMP_BER_WRITER::put_header(buffer, syn, length);//syntax & length bytes
+        memcpy(buffer + i, value, length);
+        size = i + length;
 
         syntax = syn;
         return SNMP_ERR_NO_ERROR;
@@ -629,6 +1292,7 @@ typedef struct SNMP_VALUE {
    *
    * Original Author: Agentuino Project
    * Updated: Rex Park, April 1, 2013 (modified encoding algorithm, added the ability to specify a buffer, added syntax and length)
+   * Updated: Fewest octets (canonical BER)
    */
   SNMP_ERR_CODES encode(SNMP_SYNTAXES syn, int16_t value, byte *buffer=NULL) {
     if(buffer == NULL){
@@ -636,43 +1300,8 @@ typedef struct SNMP_VALUE {
       buffer = data;
     }
     if ( syn == SNMP_SYNTAX_INT || syn == SNMP_SYNTAX_OPAQUE ) {
-      i = 3;//individual bytes are stored in reverse, start at the end
-            
-      buffer[0] = syn;
-      buffer[1] = 2;
-      
-      if(value >= 0){
-        //i <= 5 stops an infinite loop caused by using decrementer
-        while(i > 1 && i <= 3){
-          if(value > 0){
-            buffer[i--] = (value & 0xff);
-            value = value >> 8;
-          }else{
-            buffer[i--] = 0;
-          }
-        }
-      }else{
-        //i <= 5 stops an infinite loop caused by using decrementer
-        while(i > 1 && i <= 3){
-          if(value < 0){
-            buffer[i--] = (value & 0xff);
-            value = value >> 8;
-          }else{
-            buffer[i--] = 0;
-          }
-        }
-      }
-      
+      size = SNMP_BER_WRITER::put_integer(buffer, syn, value);
       syntax = syn;
-      size = 4;
-      
-      /* hack for size bug when sending large messages*/
-      if(buffer[2] == 0 && buffer[3] < 0x80){
-        buffer[1] = 1;
-        buffer[2] = buffer[3];
-        buffer[3] = 0;
-        size = 3;
-      }
       return SNMP_ERR_NO_ERROR;
     } else {
       clear();
@@ -685,6 +1314,7 @@ typedef struct SNMP_VALUE {
    * ASN Data Types: uint32
    *
    * Updated: Rex Park, December 13, 2013 (Converts unsigned int into a SNMP UInT32)
+   * Updated: Fewest octets (canonical BER)
    */
   SNMP_ERR_CODES encode(SNMP_SYNTAXES syn, uint16_t value, byte *buffer=NULL) {
     if(buffer == NULL){
@@ -693,20 +1323,8 @@ typedef struct SNMP_VALUE {
     }
     
     if(syn == SNMP_SYNTAX_UINT32){
-      
-      i = 4;//individual bytes are stored in reverse
-      
-      buffer[0] = syn;
-      buffer[1] = 3;
-      buffer[2] = 0;//for compatibility with NET-SNMP
-      
-      while(value > 0 && i >= 0){
-        buffer[i--] = (value & 0xff);
-        value = value >> 8;
-      }
-      
+      size = SNMP_BER_WRITER::put_unsigned(buffer, syn, value);
       syntax = syn;
-      size = 5;
       return SNMP_ERR_NO_ERROR;
     }else{
       clear();
@@ -720,6 +1338,7 @@ typedef struct SNMP_VALUE {
    *
    * Original Author: Agentuino Project
    * Updated: Rex Park, April 1, 2013 (modified encoding algorithm, added the ability to specify a buffer, added syntax and length)
+   * Updated: Fewest octets (canonical BER)
    */
   SNMP_ERR_CODES encode(SNMP_SYNTAXES syn, int32_t value, byte *buffer=NULL) {
     if(buffer == NULL){
@@ -728,35 +1347,8 @@ typedef struct SNMP_VALUE {
     }
     
     if(syn == SNMP_SYNTAX_INT32 || syn == SNMP_SYNTAX_OPAQUE){
-      i = 5;//individual bytes are stored in reverse, start at the end
-      
-      buffer[0] = syn;
-      buffer[1] = 4;
-      
-      if(value >= 0){
-        //i <= 5 stops an infinite loop caused by using decrementer
-        while(i > 1 && i <= 5){
-          if(value > 0){
-            buffer[i--] = (value & 0xff);
-            value = value >> 8;
-          }else{
-            buffer[i--] = 0;
-          }
-        }
-      }else{
-        //i <= 5 stops an infinite loop caused by using decrementer
-        while(i > 1 && i <= 5){
-          if(value < 0){
-            buffer[i--] = (value & 0xff);
-            value = value >> 8;
-          }else{
-            buffer[i--] = 0;
-          }
-        }
-      }
-      
+      size = SNMP_BER_WRITER::put_integer(buffer, syn, value);
       syntax = syn;
-      size = 6;
       return SNMP_ERR_NO_ERROR;
     } else {
       clear();
@@ -770,6 +1362,7 @@ typedef struct SNMP_VALUE {
    *
    * Original Author: Agentuino Project
    * Updated: Rex Park, March 29, 2013 (modified encoding algorithm, added the ability to specify a buffer, added syntax and length)
+   * Updated: Fewest octets, leading zero when the high bit is set so large values are not read as negative
    */
   SNMP_ERR_CODES encode(SNMP_SYNTAXES syn, uint32_t value, byte *buffer=NULL) {
     if(buffer == NULL){
@@ -780,19 +1373,8 @@ typedef struct SNMP_VALUE {
     if(syn == SNMP_SYNTAX_COUNTER || syn == SNMP_SYNTAX_TIME_TICKS 
       || syn == SNMP_SYNTAX_GAUGE || syn == SNMP_SYNTAX_UINT32 
       || syn == SNMP_SYNTAX_OPAQUE){
-      
-      i = 5;//individual bytes are stored in reverse
-      
-      buffer[0] = syn;
-      buffer[1] = 4;
-      
-      while(value > 0 && i >= 0){
-        buffer[i--] = (value & 0xff);
-        value = value >> 8;
-      }
-      
+      size = SNMP_BER_WRITER::put_unsigned(buffer, syn, value);
       syntax = syn;
-      size = 6;
       return SNMP_ERR_NO_ERROR;
     }else{
       clear();
@@ -860,11 +1442,12 @@ typedef struct SNMP_VALUE {
   }
   
   /**
-   * Encodes IPAddress
-   * ASN Data Types: ip address, nsap address, opaque
+   * Encodes uint64 (8 byte unsigned integer)
+   * ASN Data Types: counter64, opaque
    *
    * Original Author: Agentuino Project
    * Updated: Rex Park, April 2, 2013 (added the ability to specify a buffer, added syntax and length)
+   * Updated: Fewest octets (1 to 9), independent of host byte order
    */
   SNMP_ERR_CODES encode(SNMP_SYNTAXES syn, const uint64_t value, byte *buffer=NULL) {
     if(buffer == NULL){
@@ -873,23 +1456,8 @@ typedef struct SNMP_VALUE {
     }
         
     if ( syn == SNMP_SYNTAX_COUNTER64 || syn == SNMP_SYNTAX_OPAQUE ) {
-      buffer[0] = syn;
-      buffer[1]= 8;
-            
-      uint64_u tmp;
-      tmp.uint64 = value;
-      
-      buffer[2] = tmp.data[7];
-      buffer[3] = tmp.data[6];
-      buffer[4] = tmp.data[5];
-      buffer[5] = tmp.data[4];
-      buffer[6] = tmp.data[3];
-      buffer[7] = tmp.data[2];
-      buffer[8] = tmp.data[1];
-      buffer[9] = tmp.data[0];
-      
+      size = SNMP_BER_WRITER::put_unsigned64(buffer, syn, value);
       syntax = syn;
-      size = 10;
       return SNMP_ERR_NO_ERROR;
     } else {
       clear();
@@ -922,12 +1490,191 @@ typedef struct SNMP_VALUE {
     }
   }
   
+  //
+  // Typed setters and getters
+  //
+  
+  /**
+   * Encodes a typed value. The syntax comes from the type, there is no runtime syntax check.
+   *   With a buffer the value is written there (see SNMP_PDU::add_data), otherwise into data.
+   *   Unlike encode, data is not cleared first, only the bytes written are touched.
+   *
+   * Original Author: Rex Park
+   */
+  template<byte TAG> SNMP_ERR_CODES set(const SNMP_UNSIGNED<TAG> &v, byte *buffer=NULL) {
+    size = SNMP_BER_WRITER::put_unsigned(buffer == NULL ? data : buffer, TAG, v.value);
+    syntax = (SNMP_SYNTAXES)TAG;
+    drop_stream();
+    return SNMP_ERR_NO_ERROR;
+  }
+  
+  SNMP_ERR_CODES set(const SNMP_INTEGER32 &v, byte *buffer=NULL) {
+    size = SNMP_BER_WRITER::put_integer(buffer == NULL ? data : buffer, SNMP_SYNTAX_INT32, v.value);
+    syntax = SNMP_SYNTAX_INT32;
+    drop_stream();
+    return SNMP_ERR_NO_ERROR;
+  }
+  
+  SNMP_ERR_CODES set(const SNMP_COUNTER64 &v, byte *buffer=NULL) {
+    size = SNMP_BER_WRITER::put_unsigned64(buffer == NULL ? data : buffer, SNMP_SYNTAX_COUNTER64, v.value);
+    syntax = SNMP_SYNTAX_COUNTER64;
+    drop_stream();
+    return SNMP_ERR_NO_ERROR;
+  }
+  
+  SNMP_ERR_CODES set(const SNMP_IP_ADDRESS &v, byte *buffer=NULL) {
+    if(buffer == NULL){
+      buffer = data;
+    }
+    buffer[0] = SNMP_SYNTAX_IP_ADDRESS;
+    buffer[1] = 4;
+    for(byte n = 0; n < 4; n++){
+      buffer[2 + n] = v.value[n];
+    }
+    size = 6;
+    syntax = SNMP_SYNTAX_IP_ADDRESS;
+    drop_stream();
+    return SNMP_ERR_NO_ERROR;
+  }
+  
+  //only fails when the string doesn't fit in data, the value is cleared so the old one isn't sent by mistake
+  SNMP_ERR_CODES set(const SNMP_OCTET_STRING &v, byte *buffer=NULL) {
+    if(buffer == NULL){
+      if(v.size + 4 > SNMP_MAX_VALUE_LEN){
+        clear();
+        return SNMP_ERR_TOO_BIG;
+      }
+      buffer = data;
+    }
+    byte h = SNMP_BER_WRITER::put_header(buffer, SNMP_SYNTAX_OCTETS, v.size);
+    memcpy(buffer + h, v.data, v.size);
+    size = h + v.size;
+    syntax = SNMP_SYNTAX_OCTETS;
+    drop_stream();
+    return SNMP_ERR_NO_ERROR;
+  }
+  
+  /**
+   * Streams a value that is too large for data.
+   *   Only the syntax and length are stored, the contents are requested from producer in chunks of up to
+   *   SNMP_STREAM_CHUNK_LEN bytes while the response is written to the network, so no buffer of that size is needed.
+   *   If producer comes up short the rest of the value is padded with zeros to keep the message valid.
+   *
+   *   Streamed values are only sent as the variable binding of a response (SNMP_PDU_RESPONSE) and aren't part of
+   *   copy_packet(), the contents exist only while they are being sent.
+   *
+   * Original Author: Rex Park
+   */
+  SNMP_ERR_CODES stream(SNMP_SYNTAXES syn, uint16_t length, valueProducerCallback p, void *context=NULL) {
+    if ( syn == SNMP_SYNTAX_OCTETS || syn == SNMP_SYNTAX_OPAQUE ) {
+      size = SNMP_BER_WRITER::put_header(data, syn, length);
+      syntax = syn;
+      producer = p;
+      producer_context = context;
+      borrowed = NULL;
+      stream_size = length;
+      return SNMP_ERR_NO_ERROR;
+    } else {
+      clear();
+      return SNMP_ERR_WRONG_TYPE;
+    }
+  }
+  
+  /**
+   * Sends length bytes at value without copying them into data or the packet buffer.
+   *   The bytes are handed to the transport as their own segment (see SNMP_IOVEC), they must stay
+   *   valid until the response has been sent. Same restrictions as stream().
+   *
+   * Original Author: Rex Park
+   */
+  SNMP_ERR_CODES borrow(SNMP_SYNTAXES syn, const byte *value, uint16_t length) {
+    if ( syn == SNMP_SYNTAX_OCTETS || syn == SNMP_SYNTAX_OPAQUE ) {
+      size = SNMP_BER_WRITER::put_header(data, syn, length);
+      syntax = syn;
+      producer = NULL;
+      borrowed = value;
+      stream_size = length;
+      return SNMP_ERR_NO_ERROR;
+    } else {
+      clear();
+      return SNMP_ERR_WRONG_TYPE;
+    }
+  }
+  
+  //the value is encoded in data again, nothing is sent after the packet
+  void drop_stream(void) {
+    producer = NULL;
+    borrowed = NULL;
+    stream_size = 0;
+  }
+  
+  /**
+   * Decodes a received value into a typed value.
+   *   Returns SNMP_ERR_WRONG_TYPE if the received syntax doesn't match the type, the value is left untouched.
+   *
+   * Original Author: Rex Park
+   */
+  template<byte TAG> SNMP_ERR_CODES get(SNMP_UNSIGNED<TAG> *v) const {
+    if(syntax != TAG || size > 5 || (size == 5 && data[0] != 0)){
+      return SNMP_ERR_WRONG_TYPE;
+    }
+    uint32_t n = 0;
+    for(byte k = 0; k < size; k++){
+      n = n << 8 | data[k];
+    }
+    v->value = n;
+    return SNMP_ERR_NO_ERROR;
+  }
+  
+  SNMP_ERR_CODES get(SNMP_INTEGER32 *v) const {
+    if(syntax != SNMP_SYNTAX_INT32 || size > 4){
+      return SNMP_ERR_WRONG_TYPE;
+    }
+    int32_t n = (size > 0 && (data[0] & 0x80) != 0) ? -1 : 0;
+    for(byte k = 0; k < size; k++){
+      n = (int32_t)((uint32_t)n << 8 | data[k]);
+    }
+    v->value = n;
+    return SNMP_ERR_NO_ERROR;
+  }
+  
+  SNMP_ERR_CODES get(SNMP_COUNTER64 *v) const {
+    if(syntax != SNMP_SYNTAX_COUNTER64 || size > 9 || (size == 9 && data[0] != 0)){
+      return SNMP_ERR_WRONG_TYPE;
+    }
+    uint64_t n = 0;
+    for(byte k = 0; k < size; k++){
+      n = n << 8 | data[k];
+    }
+    v->value = n;
+    return SNMP_ERR_NO_ERROR;
+  }
+  
+  SNMP_ERR_CODES get(SNMP_IP_ADDRESS *v) const {
+    if(syntax != SNMP_SYNTAX_IP_ADDRESS || size != 4){
+      return SNMP_ERR_WRONG_TYPE;
+    }
+    v->value = IPAddress(data[0], data[1], data[2], data[3]);
+    return SNMP_ERR_NO_ERROR;
+  }
+  
+  //points v at data, nothing is copied
+  SNMP_ERR_CODES get(SNMP_OCTET_STRING *v) const {
+    if(syntax != SNMP_SYNTAX_OCTETS){
+      return SNMP_ERR_WRONG_TYPE;
+    }
+    v->data = data;
+    v->size = size;
+    return SNMP_ERR_NO_ERROR;
+  }
+  
   // clear's buffer and sets size to 0
   void clear(void) {
     //OID.clear(); Breaks encoding
     memset(data, 0, SNMP_MAX_VALUE_LEN);
     size = 0;
     i = 0;
+    drop_stream();
   }
   
   //returns the first byte of a two byte integer
@@ -941,6 +1688,32 @@ typedef struct SNMP_VALUE {
   }
 };
 
+/**
+ * sysUpTime clock. TimeTicks are hundredths of a second, kept in 32 bits so they only wrap after 497 days
+ * as the SMI expects (millis()/10 cast to 32 bits wraps after 49.7 days, together with millis()).
+ *   Whole centiseconds are carried into ticks and the remainder stays in last, nothing is lost to rounding
+ *   and a millis() rollover is just another difference. Read it at least once per millis() period,
+ *   SNMPClass::listen() does. Reading more than once per centisecond is only a subtraction and a compare.
+ *
+ * Original Auther: Rex Park
+ */
+typedef struct SNMP_UPTIME {
+  uint32_t ticks;
+  unsigned long last;//millis() when ticks was last advanced
+  
+  uint32_t read(){
+    unsigned long elapsed = millis() - last;
+    
+    if(elapsed >= 10){
+      ticks += elapsed / 10;
+      last += elapsed - elapsed % 10;
+    }
+    return ticks;
+  }
+};
+
+extern SNMP_UPTIME SNMPUptime;
+
 typedef struct SNMP_PDU {
   SNMP_PDU_TYPES type;
   int32_t version;
@@ -949,6 +1722,37 @@ typedef struct SNMP_PDU {
   int32_t errorIndex;
   SNMP_VALUE value;
   IPAddress agent_address;
+  SNMP_BER_VIEW oid_view;//encoded request OID in the receive buffer
+  SNMP_BER_VIEW value_view;//request value bytes in the receive buffer
+  
+  /**
+   * Decodes oid_view into value.OID. Only needed when lazy decoding is enabled.
+   *
+   * Original Auther: Rex Park
+   */
+  SNMP_API_STAT_CODES load_oid(){
+    if(oid_view.data == NULL || oid_view.size == 0){
+      return SNMP_API_STAT_PACKET_INVALID;
+    }
+    return value.OID.decode(oid_view.data, oid_view.size);
+  }
+
+  /**
+   * Copies value_view into value.data so the SNMP_VALUE decode functions can be used.
+   * Only needed when lazy decoding is enabled.
+   *
+   * Original Auther: Rex Park
+   */
+  SNMP_API_STAT_CODES load_value(){
+    if(value_view.size > SNMP_MAX_VALUE_LEN){
+      return SNMP_API_STAT_VALUE_TOO_BIG;
+    }
+    if(value_view.size > 0){
+      memcpy(value.data, value_view.data, value_view.size);
+    }
+    value.size = value_view.size;
+    return SNMP_API_STAT_SUCCESS;
+  }
   
   /**
    * Adds standard v2c trap data
@@ -959,6 +1763,7 @@ typedef struct SNMP_PDU {
   void prepare_trapv2(SNMP_VALUE *t_v){
     version = 1;
     type = SNMP_PDU_TRAP2;
+    requestId = 0;//assigned by send_message
     error = SNMP_ERR_NO_ERROR;
     errorIndex = 0;
     
@@ -966,10 +1771,7 @@ typedef struct SNMP_PDU {
     t_v->OID.clear();
     t_v->clear();
     t_v->OID.fromString("1.3.6.1.2.1.1.3.0");//OID of the value type being sent
-    //This line below causes error, millis() type doesn't have a definite type. 
-    //This produces different candidates for one overloaded function call.
-    //t_v->encode(SNMP_SYNTAX_TIME_TICKS, millis()/10);
-    t_v->encode(SNMP_SYNTAX_TIME_TICKS, (const uint16_t)millis()/10);
+    t_v->set(SNMP_TIME_TICKS(SNMPUptime.read()));
     value.size = add_data_private(t_v);
     
     //SNMPv2 trapOID
@@ -1005,14 +1807,13 @@ typedef struct SNMP_PDU {
    * Data length
    * Data encoded bytes
    *
-   * Reverse section adds compatibility to responsePDU rewrite.
-   *
    * Original Auther: Rex Park
    * Updated: October 26, 2015 (Created: Calls add_data_private and then updates value.size. One less step for end user.)
+   * Updated: Responses are encoded with write_varbind, reverse and temp_buffer are gone.
    */
-    void add_data(SNMP_VALUE *data, byte *buffer=NULL, boolean reverse = false, byte *temp_buffer = NULL, int extra_data_size = 0){
+    void add_data(SNMP_VALUE *data, byte *buffer=NULL, int extra_data_size = 0){
     
-      value.size = add_data_private(data,buffer,reverse,temp_buffer,extra_data_size);
+      value.size = add_data_private(data,buffer,extra_data_size);
     }
 
   /** 
@@ -1027,67 +1828,64 @@ typedef struct SNMP_PDU {
    * Data length
    * Data encoded bytes
    *
-   * Reverse section adds compatibility to responsePDU rewrite.
-   *
    * Original Auther: Rex Park
    * Updated: October 26, 2015 (Renamed to add_data_private)
    * Updated: November 4, 2013
    */
-  byte add_data_private(SNMP_VALUE *data, byte *buffer=NULL, boolean reverse = false, byte *temp_buffer = NULL, int extra_data_size = 0){
-    int index = 0;
-    byte start_index = index;
-    byte t_index = 0;
-    byte i = 0;
+  uint16_t add_data_private(SNMP_VALUE *data, byte *buffer=NULL, int extra_data_size = 0){
+    uint16_t index = 0;
+    uint16_t t_index = 0;
     
     if(buffer == NULL){
       buffer = value.data;
       index = value.size;
-      start_index = index;
     }
     
-    if(reverse == true){
-      //250 is arbitrary, just accounting for -1 being 255.
-      for(i = data->size-1; i >= 0 && i < 250; i--){//data syn + data len + data
-        buffer[index--] = data->data[i];
-      }
-      
-      t_index = data->OID.encode(temp_buffer);//oid syn + oid len + oid data
-      //250 is arbitrary, just accounting for -1 being 255.
-      for(i = t_index-1; i >= 0 && i < 250; i--){
-        buffer[index--] = temp_buffer[i];
-      }
-
-      //length of remainder of value
-      buffer[index] = lsb(start_index - index + extra_data_size);
-      buffer[index-1] = msb(start_index - index + extra_data_size);
-      index -= 2;
-      buffer[index--] = 0x82;//Sending length in two octets
-      buffer[index--] = SNMP_SYNTAX_SEQUENCE;  
-      
+    //length of remainder of value, known up front so the shortest length form can be used
+    uint16_t oid_length = data->OID.encoded_length();
+    uint16_t length = 1 + SNMP_BER_WRITER::length_size(oid_length) + oid_length + data->size + extra_data_size;
+    index += SNMP_BER_WRITER::put_header(buffer+index, SNMP_SYNTAX_SEQUENCE, length);
+    
+    t_index = data->OID.encode(buffer+index);//oid syn + oid len + oid data
+    index += t_index;
+    
+    memcpy(buffer+index, data->data, data->size);//data syn + data len + data
+    index += data->size;
+    
+    return index;//current size of buffer data was stored in
+  }
+  
+  /**
+   * Encodes a single variable binding (OID + already encoded value) into a writer.
+   *   trailing_size: value bytes that are sent after the packet (see send_message extra_data).
+   *   Streamed and borrowed values (SNMP_VALUE::stream, SNMP_VALUE::borrow) count their contents as trailing bytes as well.
+   *   A response to a lazily decoded request reuses the request's encoded OID (oid_view) without decoding it.
+   *
+   * Original Auther: Rex Park
+   */
+  void write_varbind(SNMP_BER_WRITER *writer, SNMP_VALUE *data, uint16_t trailing_size = 0){
+    uint16_t m = writer->mark();
+    
+    writer->trailing(trailing_size + data->stream_size);
+    writer->push(data->data, data->size);//data syn + data len + data
+    
+    if(data == &value && value.OID.size == 0 && oid_view.data != NULL){
+      //lazily decoded request, the response OID is the request OID, copy its encoding as is
+      writer->push(oid_view.data, oid_view.size);
+      writer->push_header(SNMP_SYNTAX_OID, oid_view.size);
     }else{
-      buffer[index++] = SNMP_SYNTAX_SEQUENCE;
-      //length of remainder of value
-      buffer[index++] = 0x82;//Sending length in two octets
-      buffer[index++] = 0;
-      buffer[index++] = 0;
-      
-      t_index = data->OID.encode(buffer+index);//oid syn + oid len + oid data
-      index += t_index;
-      
-      for(i = 0; i < data->size; i++){//data syn + data len + data
-        buffer[index++] = data->data[i];
-      }
-      
-      buffer[start_index+2] = msb(index - start_index - 4 + extra_data_size);//set length
-      buffer[start_index+3] = lsb(index - start_index - 4 + extra_data_size);
+      data->OID.encode(writer);//oid syn + oid len + oid data
     }
-    
-    return start_index + data->size + t_index + 4;//current size of buffer data was stored in
+    writer->close(SNMP_SYNTAX_SEQUENCE, m);
   }
   
   void clear(){
     version = 0;
     requestId = 0;
+    oid_view.data = NULL;
+    oid_view.size = 0;
+    value_view.data = NULL;
+    value_view.size = 0;
     errorIndex = 0;
     error = SNMP_ERR_NO_ERROR;
     value.clear();
@@ -1105,6 +1903,182 @@ typedef struct SNMP_PDU {
   }
 };
 
+// encoded (syntax + length + arcs) OIDs of the two varbinds every v2 notification starts with
+const byte SNMP_SYS_UP_TIME_OID[] = {SNMP_SYNTAX_OID, 8, 0x2b, 6, 1, 2, 1, 1, 3, 0};//1.3.6.1.2.1.1.3.0
+const byte SNMP_TRAP_OID_OID[] = {SNMP_SYNTAX_OID, 10, 0x2b, 6, 1, 6, 3, 1, 1, 4, 1, 0};//1.3.6.1.6.3.1.1.4.1.0
+// used when translating v2 notifications for v1 targets (RFC 3584)
+const byte SNMP_TRAP_ENTERPRISE_OID[] = {SNMP_SYNTAX_OID, 10, 0x2b, 6, 1, 6, 3, 1, 1, 4, 3, 0};//1.3.6.1.6.3.1.1.4.3.0
+const byte SNMP_TRAPS_ARCS[] = {0x2b, 6, 1, 6, 3, 1, 1, 5};//1.3.6.1.6.3.1.1.5, the generic traps are .1 to .6 below it
+
+/**
+ * A v2 trap or inform whose OIDs are encoded once and reused for every notification sent with it.
+ *   Holds the complete snmpTrapOID.0 varbind and the encoded OID of each object varbind,
+ *   SNMPClass::send_notification copies them around the sysUpTime, request-id and object values,
+ *   which are the only parts that change between notifications.
+ *   Build it in setup() from SNMP_OIDs, or from arcs that were encoded ahead of time (BER contents, no syntax or length),
+ *   e.g. {0x2b, 6, 1, 4, 1, 0xe0, 0x39, 1} for 1.3.6.1.4.1.12345.1.
+ *   A template that did not fit SNMP_TEMPLATE_LEN or SNMP_TEMPLATE_MAX_OBJECTS has overflow set and is never sent.
+ *
+ * Original Author: Rex Park
+ */
+typedef struct SNMP_NOTIFICATION_TEMPLATE {
+  SNMP_PDU_TYPES type;
+  byte encoded[SNMP_TEMPLATE_LEN];//snmpTrapOID.0 varbind, then the object OIDs
+  uint16_t objects[SNMP_TEMPLATE_MAX_OBJECTS + 1];//start of each object OID in encoded, objects[object_count] is the end
+  byte object_count;
+  boolean overflow;
+  
+  SNMP_API_STAT_CODES begin(SNMP_PDU_TYPES t, const byte *trap_oid, uint16_t length){
+    uint16_t oid_size = 1 + SNMP_BER_WRITER::length_size(length) + length;
+    uint16_t varbind_length = sizeof(SNMP_TRAP_OID_OID) + oid_size;
+    
+    type = t;
+    object_count = 0;
+    objects[0] = 0;
+    overflow = (t != SNMP_PDU_TRAP2 && t != SNMP_PDU_INFORM_REQUEST) || 1 + SNMP_BER_WRITER::length_size(varbind_length) + varbind_length > SNMP_TEMPLATE_LEN;
+    if(overflow == true){
+      return SNMP_API_STAT_PACKET_TOO_BIG;
+    }
+    
+    uint16_t i = SNMP_BER_WRITER::put_header(encoded, SNMP_SYNTAX_SEQUENCE, varbind_length);
+    memcpy(encoded + i, SNMP_TRAP_OID_OID, sizeof(SNMP_TRAP_OID_OID));
+    i += sizeof(SNMP_TRAP_OID_OID);
+    i += SNMP_BER_WRITER::put_header(encoded + i, SNMP_SYNTAX_OID, length);
+    memcpy(encoded + i, trap_oid, length);
+    objects[0] = i + length;
+    
+    return SNMP_API_STAT_SUCCESS;
+  }
+  
+  SNMP_API_STAT_CODES begin(SNMP_PDU_TYPES t, const SNMP_OID &trap_oid){
+    byte arcs[SNMP_TEMPLATE_LEN + 4];
+    uint16_t length = trap_oid.encoded_length();
+    
+    if(length > SNMP_TEMPLATE_LEN){
+      overflow = true;
+      return SNMP_API_STAT_PACKET_TOO_BIG;
+    }
+    byte h = 1 + SNMP_BER_WRITER::length_size(length);
+    trap_oid.encode(arcs);
+    return begin(t, arcs + h, length);
+  }
+  
+  //objects are sent in the order they were added
+  SNMP_API_STAT_CODES add_object(const byte *oid, uint16_t length){
+    uint16_t end = objects[object_count];
+    
+    if(overflow == true || object_count >= SNMP_TEMPLATE_MAX_OBJECTS || end + 1 + SNMP_BER_WRITER::length_size(length) + length > SNMP_TEMPLATE_LEN){
+      overflow = true;
+      return SNMP_API_STAT_PACKET_TOO_BIG;
+    }
+    
+    end += SNMP_BER_WRITER::put_header(encoded + end, SNMP_SYNTAX_OID, length);
+    memcpy(encoded + end, oid, length);
+    objects[++object_count] = end + length;
+    
+    return SNMP_API_STAT_SUCCESS;
+  }
+  
+  SNMP_API_STAT_CODES add_object(const SNMP_OID &oid){
+    uint16_t end = objects[object_count];
+    uint16_t length = oid.encoded_length();
+    
+    if(overflow == true || object_count >= SNMP_TEMPLATE_MAX_OBJECTS || end + 1 + SNMP_BER_WRITER::length_size(length) + length > SNMP_TEMPLATE_LEN){
+      overflow = true;
+      return SNMP_API_STAT_PACKET_TOO_BIG;
+    }
+    
+    objects[++object_count] = end + oid.encode(encoded + end);
+    
+    return SNMP_API_STAT_SUCCESS;
+  }
+};
+
+/**
+ * A manager that notifications are sent to (see SNMPClass::set_target).
+ *   community is borrowed like the ones given to begin(), it may be changed in place.
+ *   version 0 targets get v2 notifications translated to v1 traps.
+ *   A target with address 0.0.0.0 is not used.
+ *   dropped counts informs given up on before the target acknowledged them, see SNMPClass::informs_dropped.
+ *   Notifications below min_severity are not sent to it, see SNMPClass::set_min_severity.
+ *
+ * Original Author: Rex Park
+ */
+typedef struct SNMP_TARGET {
+  IPAddress address;
+  uint16_t port;
+  const char *community;
+  int32_t version;
+  uint16_t dropped;
+  byte min_severity;
+};
+
+/**
+ * One subtree of a target's notification filter (see SNMPClass::add_filter).
+ *   The subtree's encoded arcs are size bytes at offset in the shared filter buffer, so matching a notification
+ *   is a memcmp against its encoded snmpTrapOID.0 value: BER arcs are self-delimiting, a byte prefix made of
+ *   whole arcs is a subtree. Filters are kept longest first, the first match for a target is the most specific.
+ *
+ * Original Author: Rex Park
+ */
+typedef struct SNMP_FILTER {
+  uint16_t offset;
+  byte size;
+  byte target;
+  boolean include;
+};
+
+/**
+ * An inform that is waiting for acknowledgements.
+ *   Only the PDU is kept, each target's message header is written again when it is resent.
+ *   pending has a bit set for each target (1 << index) that hasn't acknowledged it yet.
+ *   inflight has the bit set once the inform has been sent to that target. Pending targets without it
+ *   are waiting for room in their window (SNMP_INFORM_WINDOW), an acknowledgement makes room.
+ *   due and retries are per target: when the next resend is and how many there have been.
+ *
+ * Original Author: Rex Park
+ */
+typedef struct SNMP_PENDING_INFORM {
+  uint32_t request_id;
+  uint32_t pending;
+  uint32_t inflight;
+  unsigned long due[SNMP_MAX_TARGETS];//millis()
+  byte retries[SNMP_MAX_TARGETS];
+  uint16_t size;
+  byte pdu[SNMP_MAX_PACKET_LEN];
+};
+
+/**
+ * Persistent copy of the pending inform table, an append-only ring of records on storage reached through callbacks
+ * (EEPROM, FRAM, flash, an SD card file or an mmap'd file).
+ *   Storage layout: two 16 byte superblocks, then the ring.
+ *   A record: 'J', type, sequence (4), payload length (2), payload, Fletcher-16 of everything after 'J'.
+ *   Enqueue payload: request id (4), pending targets (4), encoded PDU. Ack payload: request id (4), targets still pending (4).
+ *   The superblock points at the oldest record that is still needed (tail) and its sequence number. Replay follows
+ *   records from there while the sequence numbers continue and the checksums match, the first one that doesn't is the head.
+ *   Before the ring could overrun the tail the pending informs are written again at the head (a checkpoint)
+ *   and the other superblock is pointed at them, so a reset at any point replays a complete table.
+ *   Records collect in buffer and are written together, at the latest SNMP_JOURNAL_FLUSH_MS later.
+ *
+ * Original Author: Rex Park
+ */
+typedef struct SNMP_JOURNAL {
+  journalReadCallback read;
+  journalWriteCallback write;
+  void *context;
+  uint32_t ring_size;//storage size without the superblocks
+  uint32_t head;//ring offset of the next record
+  uint32_t tail;//ring offset of the oldest record replay needs
+  uint32_t used;//bytes from tail to head
+  uint32_t sequence;//of the next record
+  uint32_t generation;//of the current superblock
+  uint16_t buffered;//bytes in buffer, they belong just before head
+  unsigned long buffered_at;
+  uint16_t failed;//records that could not be written
+  byte buffer[SNMP_JOURNAL_BUFFER_LEN];
+};
+
+#ifndef SNMP_HOST
 class SNMPClass {
 public:
   SNMP_API_STAT_CODES begin(const char *getCommName,const char *setCommName,const char *trapComName, uint16_t port);
@@ -1113,8 +2087,32 @@ public:
   void send_message(IPAddress address, uint16_t port, byte *packet, uint16_t packet_size);
   uint32_t send_message(SNMP_PDU *pdu, IPAddress to_address, uint16_t to_port, byte* b = NULL, char *extra_data = NULL);
   void resend_message(IPAddress address, uint16_t port, char *extra_data = NULL);
-  uint32_t sendTrapv1(SNMP_PDU *pdu, SNMP_TRAP_TYPES trap_type, int16_t specific_trap, IPAddress manager_address);
+  uint32_t sendTrapv1(SNMP_PDU *pdu, SNMP_TRAP_TYPES trap_type, int32_t specific_trap, IPAddress manager_address);
+  uint32_t send_notification(SNMP_NOTIFICATION_TEMPLATE *notification, SNMP_VALUE *values, IPAddress to_address, uint16_t to_port);
+  uint32_t next_request_id();
+  uint32_t uptime();
+  void set_agent_address(IPAddress address);
+  SNMP_API_STAT_CODES set_target(byte index, IPAddress address, uint16_t port, const char *community, int32_t version = 1);
+  void remove_target(byte index);
+  uint32_t notify(SNMP_PDU *pdu, byte severity = 0);
+  uint32_t notify(SNMP_NOTIFICATION_TEMPLATE *notification, SNMP_VALUE *values, byte severity = 0);
+  SNMP_API_STAT_CODES add_filter(byte index, const SNMP_OID &subtree, boolean include);
+  SNMP_API_STAT_CODES add_filter(byte index, const byte *subtree, byte length, boolean include);
+  void clear_filters(byte index);
+  void set_min_severity(byte index, byte severity);
+  void set_inform_timeout(unsigned long timeout_ms);
+  void process_informs();
+  boolean acknowledge(uint32_t request_id, IPAddress address, uint16_t port);
+  boolean cancel_inform(uint32_t request_id);
+  byte pending_informs();
+  uint16_t informs_dropped(byte index);
+  SNMP_API_STAT_CODES attach_journal(uint32_t size, journalReadCallback read, journalWriteCallback write, void *context = NULL);
+  boolean journal_flush();
+  uint16_t journal_failures();
   void onPduReceive(onPduReceiveCallback pduReceived);
+  void set_lazy_decode(boolean enabled);
+  void *scratch(uint16_t size);
+  uint16_t scratch_high_water();
   void freePdu(SNMP_PDU *pdu);
   void clear_packet();
   uint16_t copy_packet(byte *packet_store);
@@ -1123,12 +2121,39 @@ public:
   uint32_t requestCounter;
 
 private:
-  uint16_t writeHeaders(SNMP_PDU *pdu);
-  void writePacket(IPAddress address, uint16_t port, char *extra_data = NULL);
-  byte _packet[SNMP_MAX_PACKET_LEN];
-  uint16_t _packetSize;
-  uint16_t _packetPos;
-  uint16_t _packetTrapPos;
+  void writeHeaders(SNMP_BER_WRITER *writer, int32_t version);
+  void writeMessageHeader(SNMP_BER_WRITER *writer, int32_t version, const char *community, size_t community_size);
+  void writePduHeader(SNMP_BER_WRITER *writer, SNMP_PDU_TYPES type, int32_t request_id, SNMP_ERR_CODES error, int32_t error_index);
+  uint32_t writeNotification(SNMP_BER_WRITER *writer, SNMP_NOTIFICATION_TEMPLATE *notification, SNMP_VALUE *values);
+  uint32_t sendToTargets(SNMP_BER_WRITER *pdu, SNMP_PDU_TYPES type, uint32_t request_id, uint32_t targets);
+  uint32_t filterTargets(const byte *varbinds, uint16_t size, byte severity);
+  boolean sendToTarget(const SNMP_BER_WRITER *pdu, byte target);
+  boolean sendTranslatedTrap(const SNMP_BER_WRITER *pdu, byte target);
+  uint16_t readHeader(const byte *data, uint16_t size, byte *tag, uint16_t *length);
+  void removeInform(byte index);
+  void dropInform(byte index);
+  byte windowUsed(byte target);
+  void sendInform(byte index, byte target, unsigned long now);
+  void releaseInforms(byte target, unsigned long now);
+  void journalInform(byte index);
+  void journalAck(uint32_t request_id, uint32_t pending);
+  void journalRecord(byte type, uint32_t request_id, uint32_t pending, const byte *pdu, uint16_t pdu_size);
+  void journalAppend(const byte *data, uint16_t size);
+  boolean journalWriteRing(uint32_t offset, const byte *data, uint16_t size);
+  boolean journalReadRing(uint32_t offset, byte *data, uint16_t size);
+  void journalCheckpoint();
+  boolean journalReplay();
+  uint16_t fletcher16(uint16_t check, const byte *data, uint16_t size);
+  void writePacket(IPAddress address, uint16_t port);
+  void writeStream();
+  void add_segment(const byte *data, uint16_t size);
+  // separate receive and transmit buffers, a response or notification never overwrites the request
+  byte _rxPacket[SNMP_MAX_PACKET_LEN];
+  uint16_t _packetSize;//received datagram
+  uint16_t _packetPos;//parse position in _rxPacket
+  byte _txPacket[SNMP_MAX_PACKET_LEN];
+  uint16_t _txSize;
+  uint16_t _txPos;//start of the outgoing message, it is written from the end of _txPacket
   SNMP_PDU_TYPES _dstType;
   uint8_t _dstIp[4];
   uint16_t _dstPort;
@@ -1139,14 +2164,33 @@ private:
   const char *_trapCommName;
   size_t _trapSize;
   onPduReceiveCallback _callback;
-  uint16_t packet_length();
   byte lsb(uint16_t num);
   byte msb(uint16_t num);
   uint16_t combine_msb_lsb(byte msb, byte lsb);
   int _extra_data_size;
   boolean _udp_extra_data_packet;
+  boolean _lazyDecode;
+  SNMP_ARENA _scratch;
+  SNMP_IOVEC _segments[SNMP_MAX_SEGMENTS];
+  byte _segmentCount;
+  valueProducerCallback _producer;
+  void *_producerContext;
+  uint16_t _streamSize;
+  SNMP_TARGET _targets[SNMP_MAX_TARGETS];
+  IPAddress _agentAddress;//agent-addr of translated v1 traps
+  SNMP_FILTER _filters[SNMP_MAX_FILTERS];//longest subtree first
+  byte _filterCount;
+  byte _filterOids[SNMP_FILTER_LEN];
+  uint16_t _filterUsed;
+  uint32_t _filtered;//targets that have filters
+  SNMP_PENDING_INFORM _informs[SNMP_MAX_PENDING_INFORMS];//oldest first
+  byte _informCount;
+  unsigned long _informTimeout;
+  unsigned long _nextInformCheck;
+  SNMP_JOURNAL _journal;
 };
 
 extern SNMPClass SNMP;
+#endif
 
 #endif
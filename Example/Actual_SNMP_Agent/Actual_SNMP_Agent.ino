@@ -1,7 +1,6 @@
 #include <Ethernet.h>
 #include "SNMPAgent.h"
 #include "global.h"
-#include <String.h>
 
 //SNMPAgent with debug enabled
 SNMPAgent snmp_agent = SNMPAgent(true);
@@ -22,23 +21,14 @@ void setup() {
 
 
 void loop() {
-  char StringToSendToSNMP[80];
-
   // listen/handle for incoming SNMP requests
   snmp_agent.update();
   
 
   // send a basic trap with just a text string.
   if (send_trap) {
-   String TrapMessage = "Whatever data you want to send.";
-
-    int i = TrapMessage.length();
-    
-    TrapMessage.toCharArray(StringToSendToSNMP, i+1);
-    StringToSendToSNMP[i+1] = NULL;
-
     //Send the trap message
-    snmp_agent.send_inform(NOTIFICATIONS_MAJOR_OID, StringToSendToSNMP);
+    snmp_agent.send_inform(NOTIFICATIONS_MAJOR_OID, "Whatever data you want to send.");
 
     send_trap = false;
   }
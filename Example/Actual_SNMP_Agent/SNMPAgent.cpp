@@ -7,20 +7,58 @@
 #include "SNMPAgent.h"
 #include "global.h"
 
-SNMPAgent::SNMPAgent(boolean _debug): _send_tag_data(false){
-  debug_enabled = true;
+#ifdef SNMP_NO_HEAP
+#pragma GCC poison malloc calloc realloc free
+#endif
+
+#ifdef INFORM_JOURNAL_EEPROM
+#include <EEPROM.h>
+
+static boolean journal_read(uint32_t address, byte *data, uint16_t size, void *){
+  for(uint16_t i = 0; i < size; i++){
+    data[i] = EEPROM.read(address + i);
+  }
+  return true;
+}
+
+//update() skips cells that already hold the value, most of a checkpoint rewrites the same bytes
+static boolean journal_write(uint32_t address, const byte *data, uint16_t size, void *){
+  for(uint16_t i = 0; i < size; i++){
+    EEPROM.update(address + i, data[i]);
+  }
+  return true;
+}
+#endif
+
+SNMPAgent::SNMPAgent(boolean _debug): _send_tag_data(false), _coalesce_window(0), _batch_oid(NULL), _batch_events(0){
+  debug_enabled = _debug;
 }
 
 void SNMPAgent::setup(){
   _oid_del = ".";
-  snmp_inform_timeout = 60*SNMPTimeout;
 
-  _api_status = SNMP.begin(snmp_read_community.c_str(),snmp_read_write_community.c_str(),snmp_trap_community.c_str(),SNMP_DEFAULT_PORT);
+  _api_status = SNMP.begin(snmp_read_community,snmp_read_write_community,snmp_trap_community,SNMP_DEFAULT_PORT);
 
   if(_api_status == SNMP_API_STAT_SUCCESS){
     Serial.println("SNMP Agent Started");
     delay(10);
 
+    SNMP.set_agent_address(ip);
+    load_targets();
+    SNMP.set_inform_timeout(60000UL*SNMPTimeout);
+    load_inform_templates();
+
+#ifdef INFORM_JOURNAL_EEPROM
+    //informs still pending before the reset are resent by the next update()
+    if(SNMP.attach_journal(EEPROM.length(), journal_read, journal_write) != SNMP_API_STAT_SUCCESS){
+      Serial.println("EEPROM too small for the inform journal");
+    }
+#endif
+
+    if(debug_enabled == true){
+      print_memory_report();
+    }
+
   }else{
     Serial.println("Error starting SNMP Library");
   }
@@ -29,7 +67,12 @@ void SNMPAgent::setup(){
 
 void SNMPAgent::update(){
 
-  process_inform_table();
+  //the coalescing window of the open batch is over
+  if(_batch_oid != NULL && millis() - _batch_opened >= _coalesce_window){
+    flush_informs();
+  }
+
+  SNMP.process_informs();
 
   if(SNMP.listen() == true){
     process_snmp_pdu();
@@ -56,10 +99,13 @@ void SNMPAgent::process_snmp_pdu(){
     Serial.println(_pdu.requestId);
   }//Process PDU
   else{
-    memset(_oid, '\0', SNMP_MAX_OID_LEN);
-    _pdu.value.OID.toString(_oid,SNMP_MAX_OID_LEN);
-    Serial.print("OID: ");
-    Serial.println(_oid);
+    //routing below compares OID arcs directly, the string is only needed for the log
+    if(debug_enabled == true){
+      memset(_oid, '\0', SNMP_MAX_OID_LEN);
+      _pdu.value.OID.toString(_oid,SNMP_MAX_OID_LEN);
+      Serial.print("OID: ");
+      Serial.println(_oid);
+    }
 
     //Process inform responses
     if(_pdu.type == SNMP_PDU_RESPONSE){
@@ -69,10 +115,10 @@ void SNMPAgent::process_snmp_pdu(){
     else if(_pdu.type == SNMP_PDU_GET || _pdu.type == SNMP_PDU_SET){
 
       //Route the message to the correct method for further processing.
-      if(strncmp(_oid, CONFIG_OID, 21) == 0){
+      if(_pdu.value.OID.startsWith(CONFIG_OID)){
         success = process_config_command();
       }
-      else if(strncmp(_oid, MIB2_SYS_OID, 9) == 0){
+      else if(_pdu.value.OID.startsWith(MIB2_SYS_OID)){
         success = process_mib2_command();
       }
 
@@ -89,15 +135,18 @@ void SNMPAgent::process_snmp_pdu(){
   //Send the response.
   if(reply_necessary == true && !(_api_status == SNMP_API_STAT_NO_SUCH_NAME || _api_status == SNMP_API_STAT_PACKET_INVALID)){
     //send PDU response
-    clear_buffer(big_buffer,BIG_BUFFER_SIZE);
-
     _pdu.type = SNMP_PDU_RESPONSE;
 
     if(_pdu.error != SNMP_ERR_NO_ERROR){
       _pdu.value.encode(SNMP_SYNTAX_NULL);
     }
 
-    SNMP.send_message(&_pdu, SNMP.remoteIP(), SNMP.remotePort(),(byte*)big_buffer);
+    SNMP.send_message(&_pdu, SNMP.remoteIP(), SNMP.remotePort());
+  }
+
+  if(debug_enabled == true){
+    Serial.print("Scratch high water: ");
+    Serial.println(SNMP.scratch_high_water());
   }
 
   //clear _pdu
@@ -109,369 +158,294 @@ void SNMPAgent::process_snmp_pdu(){
  */
 boolean SNMPAgent::process_config_command(){
   //Network Config Branch
-  if(strncmp(_oid,CONFIG_NETWORK_OID,23) == 0){
+  if(_pdu.value.OID.startsWith(CONFIG_NETWORK_OID)){
 
-    if(strcmp_P(_oid,CONFIG_NETWORK_IP_OID) == 0){
+    if(_pdu.value.OID.equals(CONFIG_NETWORK_IP_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode((byte*)copy_buffer);
+        _status = _pdu.value.get(&temp_ip);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if((byte)copy_buffer[0] >= 0 && (byte)copy_buffer[1] >= 0 && (byte)copy_buffer[2] >= 0 && (byte)copy_buffer[3] >= 0){
-            ip[0] = copy_buffer[0];
-            ip[1] = copy_buffer[1];
-            ip[2] = copy_buffer[2];
-            ip[3] = copy_buffer[3];
-          }
+          ip = temp_ip.value;
         }
       }
 
-      _status = _pdu.value.encode_address(SNMP_SYNTAX_IP_ADDRESS, ip);
+      _status = _pdu.value.set(SNMP_IP_ADDRESS(ip));
       _pdu.error = _status;
       return true;
     }
-    else if(strcmp_P(_oid,CONFIG_NETWORK_GATEWAY_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_NETWORK_GATEWAY_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode((byte*)copy_buffer);
+        _status = _pdu.value.get(&temp_ip);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if((byte)copy_buffer[0] >= 0 && (byte)copy_buffer[1] >= 0 && (byte)copy_buffer[2] >= 0 && (byte)copy_buffer[3] >= 0){
-            gateway[0] = copy_buffer[0];
-            gateway[1] = copy_buffer[1];
-            gateway[2] = copy_buffer[2];
-            gateway[3] = copy_buffer[3];
-          }
+          gateway = temp_ip.value;
         }
       }
 
-      _status = _pdu.value.encode_address(SNMP_SYNTAX_IP_ADDRESS, gateway);
+      _status = _pdu.value.set(SNMP_IP_ADDRESS(gateway));
       _pdu.error = _status;
       return true;
     }
-    else if(strcmp_P(_oid,CONFIG_NETWORK_DNS_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_NETWORK_DNS_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode((byte*)copy_buffer);
+        _status = _pdu.value.get(&temp_ip);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if((byte)copy_buffer[0] >= 0 && (byte)copy_buffer[1] >= 0 && (byte)copy_buffer[2] >= 0 && (byte)copy_buffer[3] >= 0){
-            DNS[0] = copy_buffer[0];
-            DNS[1] = copy_buffer[1];
-            DNS[2] = copy_buffer[2];
-            DNS[3] = copy_buffer[3];
-          }
+          DNS = temp_ip.value;
         }
       }
 
-      _status = _pdu.value.encode_address(SNMP_SYNTAX_IP_ADDRESS, DNS);
+      _status = _pdu.value.set(SNMP_IP_ADDRESS(DNS));
       _pdu.error = _status;
       return true;
     }
-    else if(strcmp_P(_oid,CONFIG_NETWORK_SUBNET_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_NETWORK_SUBNET_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode((byte*)copy_buffer);
+        _status = _pdu.value.get(&temp_ip);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if((byte)copy_buffer[0] >= 0 && (byte)copy_buffer[1] >= 0 && (byte)copy_buffer[2] >= 0 && (byte)copy_buffer[3] >= 0){
-            subnet[0] = copy_buffer[0];
-            subnet[1] = copy_buffer[1];
-            subnet[2] = copy_buffer[2];
-            subnet[3] = copy_buffer[3];
-          }
+          subnet = temp_ip.value;
         }
       }
 
-      _status = _pdu.value.encode_address(SNMP_SYNTAX_IP_ADDRESS, subnet);
+      _status = _pdu.value.set(SNMP_IP_ADDRESS(subnet));
       _pdu.error = _status;
       return true;
     }
   }
   //SNMP CONFIG Branch
-  else if(strncmp(_oid,CONFIG_SNMP_OID,23) == 0){
+  else if(_pdu.value.OID.startsWith(CONFIG_SNMP_OID)){
 
     //Read Only Community String
-    if(strcmp_P(_oid,CONFIG_SNMP_READ_STRING_OID) == 0){
+    if(_pdu.value.OID.equals(CONFIG_SNMP_READ_STRING_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode(copy_buffer,SNMP_MAX_COMMUNITY_SIZE);
+        copy_buffer = decode_string(SNMP_MAX_COMMUNITY_SIZE);
 
-        if(_status == SNMP_ERR_NO_ERROR){
-          if(_pdu.value.size < SNMP_MAX_COMMUNITY_SIZE){
-            snmp_read_community = String(copy_buffer);
-          }
+        if(copy_buffer != NULL){
+          copy_message_to_buffer(copy_buffer, snmp_read_community, sizeof(snmp_read_community));
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_OCTETS, snmp_read_community.c_str());
+      _status = _pdu.value.set(SNMP_OCTET_STRING(snmp_read_community));
       _pdu.error = _status;
       return true;
     }
     //Read Write Community String
-    else if(strcmp_P(_oid,CONFIG_SNMP_WRITE_STRING_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_SNMP_WRITE_STRING_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
+        copy_buffer = decode_string(SNMP_MAX_COMMUNITY_SIZE);
 
-        _status = _pdu.value.decode(copy_buffer,SNMP_MAX_COMMUNITY_SIZE);
-
-        if(_status == SNMP_ERR_NO_ERROR){
-          if(_pdu.value.size < SNMP_MAX_COMMUNITY_SIZE){
-            snmp_read_write_community= String(copy_buffer);
-          }
+        if(copy_buffer != NULL){
+          copy_message_to_buffer(copy_buffer, snmp_read_write_community, sizeof(snmp_read_write_community));
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_OCTETS, snmp_read_write_community.c_str());
+      _status = _pdu.value.set(SNMP_OCTET_STRING(snmp_read_write_community));
       _pdu.error = _status;
       return true;
     }
     //Trap Community String
-    else if(strcmp_P(_oid,CONFIG_SNMP_TRAP_STRING_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_SNMP_TRAP_STRING_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
+        copy_buffer = decode_string(SNMP_MAX_COMMUNITY_SIZE);
 
-        _status = _pdu.value.decode(copy_buffer,SNMP_MAX_COMMUNITY_SIZE);
-
-        if(_status == SNMP_ERR_NO_ERROR){
-          if(_pdu.value.size < SNMP_MAX_COMMUNITY_SIZE){
-            snmp_trap_community= String(copy_buffer);
-          }
+        if(copy_buffer != NULL){
+          copy_message_to_buffer(copy_buffer, snmp_trap_community, sizeof(snmp_trap_community));
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_OCTETS, snmp_trap_community.c_str());
+      _status = _pdu.value.set(SNMP_OCTET_STRING(snmp_trap_community));
       _pdu.error = _status;
       return true;
     }
     //SNMP Manager IP Address 1
-    else if(strcmp_P(_oid,CONFIG_SNMP_MANAGER_1_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_SNMP_MANAGER_1_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode((byte*)copy_buffer);
+        _status = _pdu.value.get(&temp_ip);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if((byte)copy_buffer[0] >= 0 && (byte)copy_buffer[1] >= 0 && (byte)copy_buffer[2] >= 0 && (byte)copy_buffer[3] >= 0){
-            SNMPIP1[0] = copy_buffer[0];
-            SNMPIP1[1] = copy_buffer[1];
-            SNMPIP1[2] = copy_buffer[2];
-            SNMPIP1[3] = copy_buffer[3];
-          }
+          SNMPIP1 = temp_ip.value;
+          load_targets();
         }
       }
 
-      _status = _pdu.value.encode_address(SNMP_SYNTAX_IP_ADDRESS, SNMPIP1);
+      _status = _pdu.value.set(SNMP_IP_ADDRESS(SNMPIP1));
       _pdu.error = _status;
       return true;
     }
     //SNMP Manager IP Address 2
-    else if(strcmp_P(_oid,CONFIG_SNMP_MANAGER_2_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_SNMP_MANAGER_2_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode((byte*)copy_buffer);
+        _status = _pdu.value.get(&temp_ip);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if((byte)copy_buffer[0] >= 0 && (byte)copy_buffer[1] >= 0 && (byte)copy_buffer[2] >= 0 && (byte)copy_buffer[3] >= 0){
-            SNMPIP2[0] = copy_buffer[0];
-            SNMPIP2[1] = copy_buffer[1];
-            SNMPIP2[2] = copy_buffer[2];
-            SNMPIP2[3] = copy_buffer[3];
-          }
+          SNMPIP2 = temp_ip.value;
+          load_targets();
         }
       }
 
-      _status = _pdu.value.encode_address(SNMP_SYNTAX_IP_ADDRESS, SNMPIP2);
+      _status = _pdu.value.set(SNMP_IP_ADDRESS(SNMPIP2));
       _pdu.error = _status;
       return true;
     }
-    else if(strcmp_P(_oid,CONFIG_SNMP_INFORM_ENABLED_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_SNMP_INFORM_ENABLED_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        _status = _pdu.value.decode(&temp_int);
+        _status = _pdu.value.get(&temp_int);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if(temp_int == 0 || temp_int == 1){
-            SNMPInforms = temp_int;
+          if(temp_int.value == 0 || temp_int.value == 1){
+            SNMPInforms = temp_int.value;
           }
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_INT32, (int16_t)SNMPInforms);
+      _status = _pdu.value.set(SNMP_INTEGER32(SNMPInforms));
       _pdu.error = _status;
       return true;
     }
-    else if(strcmp_P(_oid,CONFIG_SNMP_INFORM_TIMEOUT_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_SNMP_INFORM_TIMEOUT_OID)){
       if(_pdu.type == SNMP_PDU_SET){
 
-        _status = _pdu.value.decode(&temp_int);
+        _status = _pdu.value.get(&temp_int);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if(temp_int > 0 && temp_int <= 99){
-            SNMPTimeout = temp_int;
-            snmp_inform_timeout = 60*SNMPTimeout;
+          if(temp_int.value > 0 && temp_int.value <= 99){
+            SNMPTimeout = temp_int.value;
+            SNMP.set_inform_timeout(60000UL*SNMPTimeout);
           }
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_INT32, (int16_t)SNMPTimeout);
+      _status = _pdu.value.set(SNMP_INTEGER32(SNMPTimeout));
       _pdu.error = _status;
       return true;
     }
   }
   //Site CONFIG Branch
-  else if(strncmp(_oid,CONFIG_SITE_OID,23) == 0){
+  else if(_pdu.value.OID.startsWith(CONFIG_SITE_OID)){
 
     //Site ID
-    if(strcmp_P(_oid,CONFIG_SITE_ID_OID) == 0){
+    if(_pdu.value.OID.equals(CONFIG_SITE_ID_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
+        copy_buffer = decode_string(31);
 
-        _status = _pdu.value.decode(copy_buffer,31);
-
-        if(_status == SNMP_ERR_NO_ERROR){
-          if(_pdu.value.size < 31){
-            SiteID = String(copy_buffer);
-          }
+        if(copy_buffer != NULL){
+          copy_message_to_buffer(copy_buffer, SiteID, sizeof(SiteID));
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_OCTETS, SiteID.c_str());
+      _status = _pdu.value.set(SNMP_OCTET_STRING(SiteID));
       _pdu.error = _status;
       return true;
     }
     //City
-    else if(strcmp_P(_oid,CONFIG_SITE_CITY_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_SITE_CITY_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
+        copy_buffer = decode_string(31);
 
-        _status = _pdu.value.decode(copy_buffer,31);
-
-        if(_status == SNMP_ERR_NO_ERROR){
-          if(_pdu.value.size < 31){
-            SiteCity = String(copy_buffer);
-          }
+        if(copy_buffer != NULL){
+          copy_message_to_buffer(copy_buffer, SiteCity, sizeof(SiteCity));
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_OCTETS, SiteCity.c_str());
+      _status = _pdu.value.set(SNMP_OCTET_STRING(SiteCity));
       _pdu.error = _status;
       return true;
     }
     //State
-    else if(strcmp_P(_oid,CONFIG_SITE_STATE_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_SITE_STATE_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode(copy_buffer,3);
+        copy_buffer = decode_string(3);
 
-        if(_status == SNMP_ERR_NO_ERROR){
-          if(_pdu.value.size < 3){
-            SiteState = String(copy_buffer);
-          }
+        if(copy_buffer != NULL){
+          copy_message_to_buffer(copy_buffer, SiteState, sizeof(SiteState));
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_OCTETS, SiteState.c_str());
+      _status = _pdu.value.set(SNMP_OCTET_STRING(SiteState));
       _pdu.error = _status;
       return true;
     }
   }
   //NTP CONFIG Branch
-  else if(strncmp(_oid,CONFIG_TIME_OID,23) == 0){
+  else if(_pdu.value.OID.startsWith(CONFIG_TIME_OID)){
 
     //NTP IP
-    if(strcmp_P(_oid,CONFIG_TIME_SERVER_OID) == 0){
+    if(_pdu.value.OID.equals(CONFIG_TIME_SERVER_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode((byte*)copy_buffer);
+        _status = _pdu.value.get(&temp_ip);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if((byte)copy_buffer[0] >= 0 && (byte)copy_buffer[1] >= 0 && (byte)copy_buffer[2] >= 0 && (byte)copy_buffer[3] >= 0){
-            tsIP[0] = copy_buffer[0];
-            tsIP[1] = copy_buffer[1];
-            tsIP[2] = copy_buffer[2];
-            tsIP[3] = copy_buffer[3];
-          }
+          tsIP = temp_ip.value;
         }
       }
 
-      _status = _pdu.value.encode_address(SNMP_SYNTAX_IP_ADDRESS, tsIP);
+      _status = _pdu.value.set(SNMP_IP_ADDRESS(tsIP));
       _pdu.error = _status;
       return true;
     }
     //NTP Enabled
-    else if(strcmp_P(_oid,CONFIG_TIME_ENABLE_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_TIME_ENABLE_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        _status = _pdu.value.decode(&temp_int);
+        _status = _pdu.value.get(&temp_int);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if(temp_int == 0 || temp_int == 1){
-            EnableTimeGet = temp_int;
+          if(temp_int.value == 0 || temp_int.value == 1){
+            EnableTimeGet = temp_int.value;
           }
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_INT32, (int16_t)EnableTimeGet);
+      _status = _pdu.value.set(SNMP_INTEGER32(EnableTimeGet));
       _pdu.error = _status;
       return true;
     }
     //Timezone
-    else if(strcmp_P(_oid,CONFIG_TIME_ZONE_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_TIME_ZONE_OID)){
       if(_pdu.type == SNMP_PDU_SET){
 
-        _status = _pdu.value.decode(&temp_int);
+        _status = _pdu.value.get(&temp_int);
 
         if(_status == SNMP_ERR_NO_ERROR){
-          if(temp_int >= -10 && temp_int <= 10){
-            timeZone = temp_int;
+          if(temp_int.value >= -10 && temp_int.value <= 10){
+            timeZone = temp_int.value;
           }
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_INT32, (int16_t)timeZone);
+      _status = _pdu.value.set(SNMP_INTEGER32(timeZone));
       _pdu.error = _status;
       return true;
     }
     //User Field
-    else if(strcmp_P(_oid,CONFIG_USER_OID) == 0){
+    else if(_pdu.value.OID.equals(CONFIG_USER_OID)){
       if(_pdu.type == SNMP_PDU_SET){
-        clear_buffer(copy_buffer,COPY_BUFFER_SIZE);
-
-        _status = _pdu.value.decode(copy_buffer,31);
+        copy_buffer = decode_string(31);
 
-        if(_status == SNMP_ERR_NO_ERROR){
-          if(_pdu.value.size < 31){
-            UserField = String(copy_buffer);
-          }
+        if(copy_buffer != NULL){
+          copy_message_to_buffer(copy_buffer, UserField, sizeof(UserField));
         }
       }
 
-      _status = _pdu.value.encode(SNMP_SYNTAX_OCTETS, UserField.c_str());
+      _status = _pdu.value.set(SNMP_OCTET_STRING(UserField));
       _pdu.error = _status;
       return true;
     }
   }
   //accept changes
-  else if(strcmp_P(_oid,CONFIG_ACCEPT_CHANGES_OID) == 0){
+  else if(_pdu.value.OID.equals(CONFIG_ACCEPT_CHANGES_OID)){
 
     if(_pdu.type == SNMP_PDU_SET){
-      _status = _pdu.value.decode(&temp_int);
+      _status = _pdu.value.get(&temp_int);
 
       if(_status == SNMP_ERR_NO_ERROR){
-        if(temp_int == 0 || temp_int == 1){
-          accept_changes = temp_int;
+        if(temp_int.value == 0 || temp_int.value == 1){
+          accept_changes = temp_int.value;
         }
       }
     }
 
-    _status = _pdu.value.encode(SNMP_SYNTAX_INT32, (int16_t)accept_changes);
+    _status = _pdu.value.set(SNMP_INTEGER32(accept_changes));
     _pdu.error = _status;
     return true;
   }
@@ -483,12 +457,23 @@ boolean SNMPAgent::process_config_command(){
  * Process MIB2 OIDs
  */
 boolean SNMPAgent::process_mib2_command(){
-  if(strcmp(_oid,MIB2_SYS_DESC) == 0){
+  if(_pdu.value.OID.equals(MIB2_SYS_DESC)){
 
     if(_pdu.type == SNMP_PDU_SET){
       _pdu.error = SNMP_ERR_READ_ONLY;
     }else{
-      _status = _pdu.value.encode(SNMP_SYNTAX_OCTETS, SYS_DESCRIPTION);
+      _status = _pdu.value.set(SNMP_OCTET_STRING(SYS_DESCRIPTION));
+      _pdu.error = _status;
+    }
+
+    return true;
+  }else if(_pdu.value.OID.equals(MIB2_SYS_UPTIME)){
+
+    if(_pdu.type == SNMP_PDU_SET){
+      _pdu.error = SNMP_ERR_READ_ONLY;
+    }else{
+      //same clock as the sysUpTime.0 in notifications
+      _status = _pdu.value.set(SNMP_TIME_TICKS(SNMP.uptime()));
       _pdu.error = _status;
     }
 
@@ -498,98 +483,312 @@ boolean SNMPAgent::process_mib2_command(){
   return false;
 }
 
-void SNMPAgent::process_inform_table(){
-  for(byte i = 0; i < inform_holding_table.size(); i++){
+/**
+ * Both managers are notification targets, an address of 0.0.0.0 turns one off.
+ *   Called again when a manager address is changed, informs it still has to acknowledge follow it.
+ */
+void SNMPAgent::load_targets(){
+  SNMP.set_target(0, SNMPIP1, SNMP_MANAGER_PORT, snmp_trap_community);//manager 1
+  SNMP.set_target(1, SNMPIP2, SNMP_MANAGER_PORT, snmp_trap_community);//manager 2
+  SNMP.set_min_severity(0, SNMPSeverity1);
+  SNMP.set_min_severity(1, SNMPSeverity2);
+}
 
-    tmp_entry = &inform_holding_table.get(i);
+/**
+ * Process Inform Response
+ *    Marks the inform acknowledged by the manager that sent the response
+ */
+boolean SNMPAgent::process_inform_response(){
+  return SNMP.acknowledge(_pdu.requestId, SNMP.remoteIP(), SNMP.remotePort());
+}
 
-    if(now() - tmp_entry->last_sent > snmp_inform_timeout){//5 minutes, hard coded for now
-      Serial.print("Resending inform ");
-      Serial.print(tmp_entry->request_id);
-      Serial.println("...");
-      if(SNMPIP1[0] != 0){
-        SNMP.send_message(SNMPIP1, SNMP_MANAGER_PORT, tmp_entry->snmp_packet, tmp_entry->packet_length);
+/**
+ * Stops resending an inform
+ */
+boolean SNMPAgent::remove_inform(uint32_t request_id){
+  return SNMP.cancel_inform(request_id);
+}
 
-        if(SNMPIP2[0] != 0){
-          SNMP.send_message(SNMPIP2, SNMP_MANAGER_PORT, tmp_entry->snmp_packet, tmp_entry->packet_length);
-        }
-      }
-      tmp_entry->last_sent = now();
-      delay(1000);
+//same order as _inform_templates
+static const char *const *const INFORM_TEMPLATE_OIDS[NOTIFICATION_TEMPLATE_COUNT] = {
+  &NOTIFICATIONS_MAJOR_OID,
+  &NOTIFICATIONS_MINOR_OID,
+  &NOTIFICATIONS_CRITICAL_OID,
+  &NOTIFICATIONS_INFORMATIONAL_OID,
+  &NOTIFICATIONS_RECOVERY_OID
+};
+
+//recoveries go to every manager that gets alarms, so none is left with an alarm that never clears
+static const byte INFORM_TEMPLATE_SEVERITY[NOTIFICATION_TEMPLATE_COUNT] = {
+  SEVERITY_MAJOR,
+  SEVERITY_MINOR,
+  SEVERITY_CRITICAL,
+  SEVERITY_INFORMATIONAL,
+  SEVERITY_CRITICAL
+};
+
+/**
+ * Encodes the OIDs of each notification once, send_inform then only encodes the text.
+ */
+void SNMPAgent::load_inform_templates(){
+  for(byte i = 0; i < NOTIFICATION_TEMPLATE_COUNT; i++){
+    _value.OID.fromString(*INFORM_TEMPLATE_OIDS[i]);
+    _inform_templates[i].begin(SNMP_PDU_INFORM_REQUEST, _value.OID);
+
+    _value.OID.fromString(NOTIFICATIONS_OBJECT_OID);//Notification Object
+    _inform_templates[i].add_object(_value.OID);
+
+    if(_inform_templates[i].overflow == true){
+      Serial.print("Inform template too big: ");
+      Serial.println(*INFORM_TEMPLATE_OIDS[i]);
+    }
+  }
+  _value.OID.clear();
+}
+
+//NULL if oid isn't one of the template notifications
+SNMP_NOTIFICATION_TEMPLATE *SNMPAgent::find_inform_template(const char *oid){
+  for(byte i = 0; i < NOTIFICATION_TEMPLATE_COUNT; i++){
+    if(oid == *INFORM_TEMPLATE_OIDS[i] || strcmp(oid, *INFORM_TEMPLATE_OIDS[i]) == 0){
+      return _inform_templates[i].overflow == true ? NULL : &_inform_templates[i];
+    }
+  }
+  return NULL;
+}
+
+//severity of one of the template notifications, informational for anything else
+byte SNMPAgent::inform_severity(const char *oid){
+  for(byte i = 0; i < NOTIFICATION_TEMPLATE_COUNT; i++){
+    if(oid == *INFORM_TEMPLATE_OIDS[i] || strcmp(oid, *INFORM_TEMPLATE_OIDS[i]) == 0){
+      return INFORM_TEMPLATE_SEVERITY[i];
     }
   }
+  return SEVERITY_INFORMATIONAL;
 }
 
 /**
- * Process Inform Response
- *    Removes entry from inform_holding_table
+ * Send SNMP Inform
+ *   Notifications with a template only encode the text, anything else is built from scratch.
+ *   With coalescing on the event is added to a batch instead, the returned request id is the batch's.
  */
-boolean SNMPAgent::process_inform_response(){
-  for(byte i = 0; i < inform_holding_table.size(); i++){
+uint32_t SNMPAgent::send_inform(const char *oid, const char *data){
+  if(_coalesce_window != 0){
+    return queue_inform(oid, data);
+  }
 
-    tmp_entry = &inform_holding_table.get(i);
+  SNMP_NOTIFICATION_TEMPLATE *notification = find_inform_template(oid);
 
-    if(tmp_entry->request_id == _pdu.requestId){
-      inform_holding_table.remove(i);
-      break;
-    }
+  if(notification == NULL){
+    _inform_pdu.clear();
+    _inform_pdu.value.OID.fromString(oid);//trap oid
+
+    //Pass it a value struct so it can use it for processing. Saves on overhead
+    _inform_pdu.prepare_inform(&_value);
+
+    _value.OID.fromString(NOTIFICATIONS_OBJECT_OID);//Notification Object
+  }
+
+  //with a template the OIDs are in the template
+  if(_value.set(SNMP_OCTET_STRING(data)) != SNMP_ERR_NO_ERROR){
+    Serial.println("Inform too big for one packet, dropped");
+    return 0;
   }
+
+  if(notification == NULL){
+    _inform_pdu.add_data(&_value);
+  }
+
+  return transmit_inform(notification, inform_severity(oid));
 }
 
 /**
- * Remove Inform from inform_holding_table
+ * Sends _inform_pdu (or _value through notification when it isn't NULL) to the managers,
+ * the library resends it until each of them acknowledged it.
+ * Managers with a higher SNMPSeverity are skipped, if that is all of them nothing is encoded and 0 is returned.
  */
-boolean SNMPAgent::remove_inform(uint32_t request_id){
+uint32_t SNMPAgent::transmit_inform(SNMP_NOTIFICATION_TEMPLATE *notification, byte severity){
+  uint32_t request_id;
 
-  for(byte i = 0; i < inform_holding_table.size(); i++){
+  //encoded once, sent to every manager
+  if(notification != NULL){
+    request_id = SNMP.notify(notification,&_value,severity);
+  }else{
+    request_id = SNMP.notify(&_inform_pdu,severity);
+  }
 
-    tmp_entry = &inform_holding_table.get(i);
+  if(request_id != 0){
+    Serial.print("Inform ");
+    Serial.print(request_id);
+    Serial.println(" sent...");
+  }
 
-    if(tmp_entry->request_id == request_id){
-      inform_holding_table.remove(i);
-      return true;
+  //clear _inform_pdu
+  SNMP.freePdu(&_inform_pdu);
+
+  return request_id;
+}
+
+/**
+ * Opt-in coalescing: informs sent within window_ms of the first one are merged into a single inform,
+ * one varbind per event, as long as they have the same notification OID and fit in one packet.
+ * The batch is one pending inform, one acknowledgement per manager retires every event in it.
+ * 0 (the default) turns coalescing off, an open batch is sent right away.
+ * The notification OID passed to send_inform is kept while its batch is open, use constants (e.g. NOTIFICATIONS_MAJOR_OID).
+ */
+void SNMPAgent::set_inform_coalescing(unsigned long window_ms){
+  _coalesce_window = window_ms;
+
+  if(window_ms == 0){
+    flush_informs();
+  }
+}
+
+//sends the open batch, if there is one
+void SNMPAgent::flush_informs(){
+  if(_batch_oid == NULL){
+    return;
+  }
+
+  if(debug_enabled == true){
+    Serial.print("Inform batch of ");
+    Serial.print(_batch_events);
+    Serial.println(" events");
+  }
+
+  byte severity = inform_severity(_batch_oid);
+
+  _batch_oid = NULL;
+  _batch_events = 0;
+  transmit_inform(NULL, severity);
+}
+
+uint32_t SNMPAgent::queue_inform(const char *oid, const char *data){
+  //one snmpTrapOID per message, a different notification starts a new batch
+  if(_batch_oid != NULL && oid != _batch_oid && strcmp(oid, _batch_oid) != 0){
+    flush_informs();
+  }
+
+  if(_batch_oid == NULL){
+    open_inform_batch(oid);
+  }
+
+  //too big for any batch, the events already in the open one are kept
+  if(add_inform_event(data) == false){
+    Serial.println("Inform too big for one packet, dropped");
+    if(_batch_events == 0){
+      _batch_oid = NULL;
     }
+    return 0;
   }
 
-  return false;
+  //full, send it and carry the event over to a new batch
+  if(inform_event_fits() == false && _batch_events > 0){
+    flush_informs();
+    open_inform_batch(oid);
+    add_inform_event(data);
+  }
+
+  if(inform_event_fits() == false){
+    Serial.println("Inform too big for one packet, dropped");
+    _batch_oid = NULL;
+    return 0;
+  }
+
+  _inform_pdu.add_data(&_value);
+  _batch_events++;
+
+  //sending clears the PDU, keep the batch's request id
+  uint32_t request_id = _inform_pdu.requestId;
+
+  //nothing else would fit
+  if(_batch_events == 255){
+    flush_informs();
+  }
+
+  return request_id;
 }
 
 /**
- * Send SNMP Inform
+ * Starts a batch, its request id is reserved now so send_inform can return it before the batch is sent.
  */
-uint32_t SNMPAgent::send_inform(const char *oid, const char *data){
-  _pdu.clear();
-  _pdu.value.OID.fromString(oid);//trap oid
-
-  //Pass it a value struct so it can use it for processing. Saves on overhead
-  _pdu.prepare_inform(&_value);
+void SNMPAgent::open_inform_batch(const char *oid){
+  _inform_pdu.clear();
+  _inform_pdu.value.OID.fromString(oid);//trap oid
+  _inform_pdu.prepare_inform(&_value);
+  _inform_pdu.requestId = SNMP.next_request_id();
+
+  _batch_oid = oid;
+  _batch_events = 0;
+  _batch_opened = millis();
+}
 
+//encodes the event into _value, prepare_inform uses _value too so this comes after open_inform_batch
+//false if the text doesn't fit in a value
+boolean SNMPAgent::add_inform_event(const char *data){
   _value.OID.fromString(NOTIFICATIONS_OBJECT_OID);//Notification Object
-  _value.encode(SNMP_SYNTAX_OCTETS, data);
-  _pdu.add_data(&_value);
+  return _value.set(SNMP_OCTET_STRING(data)) == SNMP_ERR_NO_ERROR;
+}
 
-  //send it
-  SNMP_INFORM_TABLE_ENTRY new_entry;
+//true if the varbind in _value still fits in the batch's PDU and in one packet
+boolean SNMPAgent::inform_event_fits(){
+  uint16_t oid_length = _value.OID.encoded_length();
+  uint16_t length = 1 + SNMP_BER_WRITER::length_size(oid_length) + oid_length + _value.size;
+  uint16_t size = _inform_pdu.value.size + 1 + SNMP_BER_WRITER::length_size(length) + length;
 
-  if(SNMPIP1[0] != 0){
-    new_entry.request_id = SNMP.send_message(&_pdu,SNMPIP1,SNMP_MANAGER_PORT);//manager 1
+  return size <= SNMP_MAX_VALUE_LEN && size + INFORM_BATCH_OVERHEAD <= SNMP_MAX_PACKET_LEN;
+}
 
-    if(SNMPIP2[0] != 0){
-      SNMP.resend_message(SNMPIP2,SNMP_MANAGER_PORT);//manager 2
-    }
+/**
+ * Decodes a string value into scratch memory from the library.
+ *   Returns NULL if the value isn't a string or is max_size characters or longer.
+ *   The buffer is only valid while the current request is handled.
+ */
+char *SNMPAgent::decode_string(byte max_size){
+  char *buffer = (char*)SNMP.scratch(max_size);
 
-    Serial.print("Inform ");
-    Serial.print(new_entry.request_id);
-    Serial.println(" sent...");
+  if(buffer == NULL){
+    _status = SNMP_ERR_TOO_BIG;
+    return NULL;
   }
 
-  new_entry.packet_length = SNMP.copy_packet(new_entry.snmp_packet);
-  new_entry.last_sent = now();
-  inform_holding_table.add(new_entry);
+  //decode needs room for the terminator
+  _status = _pdu.value.decode(buffer, max_size - 1);
 
-  SNMP.clear_packet();
-  //clear _pdu
-  SNMP.freePdu(&_pdu);
+  if(_status != SNMP_ERR_NO_ERROR){
+    return NULL;
+  }
+
+  return buffer;
+}
+
+/**
+ * Static RAM used by the library and the agent. Everything is sized at compile time, there is nothing on the heap.
+ */
+void SNMPAgent::print_memory_report(){
+  Serial.println("Static RAM (bytes):");
+  Serial.print("  SNMP library: ");
+  Serial.println((unsigned int)sizeof(SNMPClass));
+  Serial.print("    receive buffer: ");
+  Serial.println((unsigned int)SNMP_MAX_PACKET_LEN);
+  Serial.print("    transmit buffer: ");
+  Serial.println((unsigned int)SNMP_MAX_PACKET_LEN);
+  Serial.print("    scratch: ");
+  Serial.println((unsigned int)SNMP_SCRATCH_LEN);
+  Serial.print("    pending informs: ");
+  Serial.println((unsigned int)(SNMP_MAX_PENDING_INFORMS * sizeof(SNMP_PENDING_INFORM)));
+  Serial.print("    journal buffer: ");
+  Serial.println((unsigned int)SNMP_JOURNAL_BUFFER_LEN);
+  Serial.print("  Agent: ");
+  Serial.println((unsigned int)sizeof(SNMPAgent));
+  Serial.print("    PDU (x2): ");
+  Serial.println((unsigned int)sizeof(SNMP_PDU));
+  Serial.print("    value: ");
+  Serial.println((unsigned int)sizeof(SNMP_VALUE));
+  Serial.print("    inform templates: ");
+  Serial.println((unsigned int)sizeof(_inform_templates));
+  Serial.print("  Config strings: ");
+  Serial.println((unsigned int)(sizeof(SiteID) + sizeof(SiteCity) + sizeof(SiteState) + sizeof(UserField) + sizeof(Password)
+    + sizeof(snmp_read_community) + sizeof(snmp_read_write_community) + sizeof(snmp_trap_community)));
 }
 
 void SNMPAgent::clear_buffer(char buffer[], byte buffer_size){
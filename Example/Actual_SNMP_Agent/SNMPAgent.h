@@ -14,28 +14,37 @@
 #include "Time.h"
 #include "global.h"
 
-#define SNMP_MAX_COMMUNITY_SIZE SNMP_MAX_NAME_LEN
-#define COPY_BUFFER_SIZE 41
-#define BIG_BUFFER_SIZE 80
+#define NOTIFICATION_TEMPLATE_COUNT 5 //major, minor, critical, informational, recovery
+//alarm severities passed to SNMP.notify(), a manager only gets alarms at or above its SNMPSeverity
+#define SEVERITY_INFORMATIONAL 0
+#define SEVERITY_MINOR 1
+#define SEVERITY_MAJOR 2
+#define SEVERITY_CRITICAL 3
+#define INFORM_BATCH_OVERHEAD (32 + SNMP_MAX_COMMUNITY_SIZE) //message bytes outside the varbinds of a batched inform, upper bound
+//#define INFORM_JOURNAL_EEPROM //keep pending informs in EEPROM across resets, needs SNMP_JOURNAL_MIN_SIZE bytes of it
+
 
 class SNMPAgent {
   private:
     SNMP_API_STAT_CODES _api_status;
     SNMP_ERR_CODES _status;
     SNMP_PDU _pdu;
+    SNMP_PDU _inform_pdu;//separate from _pdu so informs can be sent while a request is handled
     SNMP_VALUE _value;
     char _oid[SNMP_MAX_OID_LEN];
     boolean _send_tag_data;
     char *_oid_del;
-    unsigned long snmp_inform_timeout;
-
-    SNMP_INFORM_TABLE_ENTRY *tmp_entry;
+    SNMP_NOTIFICATION_TEMPLATE _inform_templates[NOTIFICATION_TEMPLATE_COUNT];//one per notification OID, built in setup()
+    unsigned long _coalesce_window;//ms, 0 sends every inform right away
+    unsigned long _batch_opened;
+    const char *_batch_oid;//notification OID of the open batch, NULL when no batch is open
+    byte _batch_events;
 
     int _factor;
     uint16_t temp_uint;
-    int16_t temp_int;
-    char copy_buffer[COPY_BUFFER_SIZE];
-    char big_buffer[BIG_BUFFER_SIZE];
+    SNMP_INTEGER32 temp_int;
+    SNMP_IP_ADDRESS temp_ip;
+    char *copy_buffer;//scratch memory from SNMP, see decode_string
 
     boolean debug_enabled;
 
@@ -43,10 +52,18 @@ class SNMPAgent {
     boolean process_config_command();
     boolean process_mib2_command();
 
-    void process_inform_table();
+    void load_targets();
     boolean process_inform_response();
-    void load_inform_table();
+    void load_inform_templates();
+    SNMP_NOTIFICATION_TEMPLATE *find_inform_template(const char *oid);
+    byte inform_severity(const char *oid);
+    uint32_t transmit_inform(SNMP_NOTIFICATION_TEMPLATE *notification, byte severity);
+    uint32_t queue_inform(const char *oid, const char *data);
+    void open_inform_batch(const char *oid);
+    boolean add_inform_event(const char *data);
+    boolean inform_event_fits();
 
+    char *decode_string(byte max_size);
     void clear_buffer(char buffer[], byte buffer_size);
     void clear_buffer(byte buffer[], byte buffer_size);
     void copy_message_to_buffer(const char *message, char buffer[], byte length);
@@ -58,6 +75,9 @@ class SNMPAgent {
     void update();
     boolean remove_inform(uint32_t request_id);
     uint32_t send_inform(const char *oid, const char *data);
+    void set_inform_coalescing(unsigned long window_ms);
+    void flush_informs();
     void set_next_request_id(uint32_t request_id);
+    void print_memory_report();
 };
 #endif
@@ -1,5 +1,9 @@
 #include "global.h"
 
+#ifdef SNMP_NO_HEAP
+#pragma GCC poison malloc calloc realloc free
+#endif
+
 //System Global Setup vars
 //These should be saved/loaded from EEPROM or an SD Card.
 IPAddress ip(192, 168, 1, 2);   //local ip
@@ -8,24 +12,24 @@ IPAddress subnet(0, 0, 0, 0);    //subnet mask
 IPAddress DNS(0, 0, 0, 0);       //DNS server ip address
 IPAddress SNMPIP1(192, 168, 1, 5);   //Remote NMS for SNMP Informs #1
 IPAddress SNMPIP2(192, 168, 1, 6);   //Remote NMS for SNMP Informs #2
+byte SNMPSeverity1 = 0;  //every alarm to NMS #1
+byte SNMPSeverity2 = 0;  //every alarm to NMS #2
 byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
-String SiteID = "999999";          //Site ID, value read from SD card
-String SiteCity = "Springfield";      // Site City
-String SiteState = "FX";           // Site State
+char SiteID[SITE_STRING_SIZE] = "999999";          //Site ID, value read from SD card
+char SiteCity[SITE_STRING_SIZE] = "Springfield";      // Site City
+char SiteState[SITE_STATE_SIZE] = "FX";           // Site State
 int SNMPInforms = 1;  // SNMPInforms enabled by default, set to 0 to turn off
-String snmp_read_community = "public";
-String snmp_read_write_community = "private";
-String snmp_trap_community = "private";
+char snmp_read_community[SNMP_MAX_COMMUNITY_SIZE] = "public";
+char snmp_read_write_community[SNMP_MAX_COMMUNITY_SIZE] = "private";
+char snmp_trap_community[SNMP_MAX_COMMUNITY_SIZE] = "private";
 IPAddress tsIP(192,168,1,1);  // Time Server ip address
-String UserField = "User-Data";  // User Field
+char UserField[SITE_STRING_SIZE] = "User-Data";  // User Field
 int EnableTimeGet = 1; //Setting to allow retrieval of current time and date from the time server
 int SNMPTimeout = 5;  // 5 minute default
-String Password = "1234ABCD";
+char Password[9] = "1234ABCD";
 int timeZone = -6; //Central Standard Time
 boolean accept_changes = false;
 
-LinkedList<SNMP_INFORM_TABLE_ENTRY> inform_holding_table = LinkedList<SNMP_INFORM_TABLE_ENTRY>();
-
 /**
  * Read Only Strings
  */
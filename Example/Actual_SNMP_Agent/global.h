@@ -5,7 +5,11 @@
 #include <EthernetUdp.h>
 #include <Time.h>
 #include <ArduinoSNMP.h> //add to your libraries folder
-#include <LinkedList.h>
+
+//Fixed capacity strings and tables, the agent doesn't use the heap (see SNMP_NO_HEAP)
+#define SNMP_MAX_COMMUNITY_SIZE SNMP_MAX_NAME_LEN
+#define SITE_STRING_SIZE 31 //Site ID, City, User Field
+#define SITE_STATE_SIZE 3
 
 //System Global Setup vars
 //These should be saved/loaded from EEPROM or an SD Card.
@@ -15,31 +19,24 @@ extern IPAddress subnet;    //subnet mask
 extern IPAddress DNS;       //DNS server ip address
 extern IPAddress SNMPIP1;   //Remote NMS for SNMP Informs #1
 extern IPAddress SNMPIP2;   //Remote NMS for SNMP Informs #2
+extern byte SNMPSeverity1;  //lowest alarm severity sent to NMS #1, see SEVERITY_ in SNMPAgent.h
+extern byte SNMPSeverity2;  //lowest alarm severity sent to NMS #2
 extern byte mac[];
-extern String SiteID;          //Site ID, value read from SD card
-extern String SiteCity;      // Site City
-extern String SiteState;           // Site State
+extern char SiteID[SITE_STRING_SIZE];          //Site ID, value read from SD card
+extern char SiteCity[SITE_STRING_SIZE];      // Site City
+extern char SiteState[SITE_STATE_SIZE];           // Site State
 extern int SNMPInforms;  // SNMPInforms enabled by default, set to 0 to turn off
-extern String snmp_read_community;
-extern String snmp_read_write_community;
-extern String snmp_trap_community;
+extern char snmp_read_community[SNMP_MAX_COMMUNITY_SIZE];
+extern char snmp_read_write_community[SNMP_MAX_COMMUNITY_SIZE];
+extern char snmp_trap_community[SNMP_MAX_COMMUNITY_SIZE];
 extern IPAddress tsIP;  // Time Server ip address
-extern String UserField;
+extern char UserField[SITE_STRING_SIZE];
 extern int EnableTimeGet; //Setting to allow retrieval of current time and date from the time server
 extern int SNMPTimeout;  // 5 minute default
-extern String Password;
+extern char Password[9];
 extern int timeZone; //Eastern Standard Time
 extern boolean accept_changes;
 
-typedef struct SNMP_INFORM_TABLE_ENTRY {
-  uint32_t request_id;
-  byte snmp_packet[SNMP_MAX_PACKET_LEN];
-  uint16_t packet_length;
-  time_t last_sent;
-};
-
-extern LinkedList<SNMP_INFORM_TABLE_ENTRY> inform_holding_table;
-
 /**
  * Read Only Strings
  */
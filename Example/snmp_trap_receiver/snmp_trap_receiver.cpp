@@ -0,0 +1,1149 @@
+/**
+ * SNMPv2c trap and inform receiver for Linux hosts, built on the ArduinoSNMP BER types.
+ * Copyright (C) 2013 Rex Park <rex.park@me.com>
+ * All rights reserved.
+ *
+ * Receives batches of datagrams with recvmmsg(), decodes Trap-PDUs and InformRequest-PDUs with any number of
+ * varbinds, acknowledges informs with a Response-PDU carrying the same request-id and varbinds (RFC 3416 4.2.7),
+ * drops retransmissions it has already seen and logs every other notification as one line.
+ * Informs that are retransmitted are acknowledged again, the first response may have been lost.
+ *
+ * Build:
+ *   g++ -O2 -std=gnu++11 -DSNMP_HOST -I../.. -o snmp_trap_receiver snmp_trap_receiver.cpp
+ *
+ * Usage:
+ *   snmp_trap_receiver [-p port] [-c community] [-o log_file] [-j store_dir] [-w dedup_seconds] [-q]
+ *     -p  UDP port, 162 by default
+ *     -c  only accept this community, any community by default
+ *     -o  append the log to a file instead of stdout
+ *     -j  also keep every notification in an indexed store, see trap_store.h
+ *     -w  how long a notification is remembered for duplicate detection, 300 seconds by default
+ *     -q  count notifications without logging them
+ *   snmp_trap_receiver --bench count [--seed n] [-o log_file] [-j store_dir] [-q]
+ *     decode, duplicate check, response and log line for count generated notifications, without sockets.
+ *     The same seed always generates the same notifications, about 10% of them retransmissions.
+ *     With -j they are stored 4 ms apart, ending now.
+ *   snmp_trap_receiver --query store_dir [--from time] [--to time] [--source address[/bits]] [--count]
+ *     logs the stored notifications in the time range from the source addresses, oldest first.
+ *     time is 2026-01-31T12:00:00 (UTC), seconds since 1970, or -90s, -15m, -1h, -2d from now.
+ *   snmp_trap_receiver --flood host:port count [--seed n]
+ *     sends the generated notifications to a running receiver with sendmmsg()
+ *
+ * Counters are written to stderr when the receiver is stopped (SIGINT or SIGTERM).
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ArduinoSNMP.h"
+#include "trap_store.h"
+
+#define RECEIVER_BATCH        64          //datagrams per recvmmsg()
+#define RECEIVER_DATAGRAM_LEN 65535       //largest UDP payload plus one, longer ones are truncated and counted invalid
+#define RECEIVER_LOG_LEN      (1 << 20)   //log lines collected before they are written
+#define DEDUP_SLOTS           (1 << 20)   //remembered notifications, 16 bytes each
+#define DEDUP_PROBE           8           //slots looked at for each notification, the oldest of them is replaced
+
+typedef struct RECEIVER_STATS {
+  uint64_t datagrams;
+  uint64_t notifications;
+  uint64_t informs;
+  uint64_t duplicates;
+  uint64_t responses;
+  uint64_t invalid;
+  uint64_t ignored;//other PDU types and SNMP versions
+  uint64_t wrong_community;
+};
+
+/**
+ * One decoded message. The views point into the datagram, nothing is copied.
+ *   varbind_list is the complete SEQUENCE so the response can repeat it as is.
+ */
+typedef struct RECEIVED_NOTIFICATION {
+  int32_t version;
+  SNMP_BER_VIEW community;
+  byte type;
+  int32_t request_id;
+  SNMP_BER_VIEW pdu;
+  SNMP_BER_VIEW varbind_list;
+  SNMP_BER_VIEW varbinds;
+};
+
+typedef enum RECEIVE_RESULTS {
+  RECEIVE_NOTIFICATION,
+  RECEIVE_INVALID,
+  RECEIVE_IGNORED
+};
+
+typedef struct DEDUP_ENTRY {
+  uint64_t fingerprint;//0 is an empty slot
+  uint32_t seen;//seconds
+};
+
+typedef struct LOG_OUTPUT {
+  int fd;//-1 formats lines without writing them
+  boolean enabled;
+  uint32_t used;
+  char buffer[RECEIVER_LOG_LEN];
+  char stamp[32];//time of the current batch
+};
+
+static RECEIVER_STATS stats;
+static DEDUP_ENTRY *dedup;
+static uint32_t dedup_window = 300;
+static const char *accepted_community = NULL;
+static LOG_OUTPUT output;
+static SNMP_VALUE scratch_value;
+static SNMP_OID scratch_oid;
+static volatile sig_atomic_t stopping = 0;
+static TRAP_STORE *store = NULL;
+static uint64_t batch_time;//ms since 1970, stored with the notifications of the batch
+
+//
+// Decoding
+//
+
+//reads one TLV at *pos, contents is its value. Definite lengths up to 16 bits, which is all a datagram can hold
+static boolean read_tlv(const byte *data, uint16_t size, uint16_t *pos, byte *tag, SNMP_BER_VIEW *contents){
+  uint16_t p = *pos;
+  uint32_t length;
+
+  if(p + 2 > size){
+    return false;
+  }
+  *tag = data[p++];
+  length = data[p++];
+
+  if(length & 0x80){
+    byte n = length & 0x7F;
+
+    if(n == 0 || n > 2 || p + n > size){
+      return false;
+    }
+    for(length = 0; n > 0; n--){
+      length = length << 8 | data[p++];
+    }
+  }
+
+  if(length > (uint32_t)(size - p)){
+    return false;
+  }
+
+  contents->data = data + p;
+  contents->size = length;
+  *pos = p + length;
+  return true;
+}
+
+static boolean read_integer(const SNMP_BER_VIEW &view, int32_t *value){
+  if(view.size == 0 || view.size > 4){
+    return false;
+  }
+
+  //sign extended like SNMP_VALUE::decode
+  *value = (view.data[0] & 0x80) ? -1 : 0;
+  for(uint16_t i = 0; i < view.size; i++){
+    *value = (*value << 8) | view.data[i];
+  }
+  return true;
+}
+
+/**
+ * Message, version, community, PDU header and the varbind list.
+ *   The varbinds themselves are only walked when the notification is logged.
+ */
+static RECEIVE_RESULTS decode_notification(const byte *packet, uint16_t size, RECEIVED_NOTIFICATION *n){
+  SNMP_BER_VIEW message, field;
+  uint16_t pos = 0;
+  uint16_t list_start;
+  byte tag;
+  int32_t value;
+
+  if(read_tlv(packet, size, &pos, &tag, &message) == false || tag != SNMP_SYNTAX_SEQUENCE){
+    return RECEIVE_INVALID;
+  }
+
+  pos = 0;
+  if(read_tlv(message.data, message.size, &pos, &tag, &field) == false || tag != SNMP_SYNTAX_INT || read_integer(field, &n->version) == false){
+    return RECEIVE_INVALID;
+  }
+  if(read_tlv(message.data, message.size, &pos, &tag, &n->community) == false || tag != SNMP_SYNTAX_OCTETS){
+    return RECEIVE_INVALID;
+  }
+  if(read_tlv(message.data, message.size, &pos, &n->type, &n->pdu) == false){
+    return RECEIVE_INVALID;
+  }
+
+  //v2c only, v1 traps have a different PDU and informs don't exist there
+  if(n->version != 1 || (n->type != SNMP_PDU_TRAP2 && n->type != SNMP_PDU_INFORM_REQUEST)){
+    return RECEIVE_IGNORED;
+  }
+
+  pos = 0;
+  if(read_tlv(n->pdu.data, n->pdu.size, &pos, &tag, &field) == false || tag != SNMP_SYNTAX_INT || read_integer(field, &n->request_id) == false){
+    return RECEIVE_INVALID;
+  }
+
+  //error-status and error-index, always 0 in notifications
+  for(byte i = 0; i < 2; i++){
+    if(read_tlv(n->pdu.data, n->pdu.size, &pos, &tag, &field) == false || tag != SNMP_SYNTAX_INT || read_integer(field, &value) == false){
+      return RECEIVE_INVALID;
+    }
+  }
+
+  list_start = pos;
+  if(read_tlv(n->pdu.data, n->pdu.size, &pos, &tag, &n->varbinds) == false || tag != SNMP_SYNTAX_SEQUENCE){
+    return RECEIVE_INVALID;
+  }
+  n->varbind_list.data = n->pdu.data + list_start;
+  n->varbind_list.size = pos - list_start;
+
+  return RECEIVE_NOTIFICATION;
+}
+
+//
+// Duplicates
+//
+
+//FNV-1a over the sender and the PDU, a retransmission repeats the PDU byte for byte
+static uint64_t fingerprint(uint32_t address, uint16_t port, const SNMP_BER_VIEW &pdu){
+  uint64_t hash = 14695981039346656037ULL;
+  byte sender[6];
+
+  memcpy(sender, &address, 4);
+  memcpy(sender + 4, &port, 2);
+  for(byte i = 0; i < sizeof(sender); i++){
+    hash = (hash ^ sender[i]) * 1099511628211ULL;
+  }
+  for(uint16_t i = 0; i < pdu.size; i++){
+    hash = (hash ^ pdu.data[i]) * 1099511628211ULL;
+  }
+
+  return hash == 0 ? 1 : hash;
+}
+
+/**
+ * True if the fingerprint was seen within dedup_window seconds, it is remembered from now on either way.
+ *   Fixed size table: a new fingerprint replaces the oldest of DEDUP_PROBE neighbouring slots.
+ */
+static boolean seen_before(uint64_t print, uint32_t now){
+  uint32_t start = print & (DEDUP_SLOTS - 1);
+  DEDUP_ENTRY *oldest = NULL;
+
+  for(byte i = 0; i < DEDUP_PROBE; i++){
+    DEDUP_ENTRY *entry = &dedup[(start + i) & (DEDUP_SLOTS - 1)];
+
+    if(entry->fingerprint == print && now - entry->seen <= dedup_window){
+      entry->seen = now;
+      return true;
+    }
+    if(oldest == NULL || entry->fingerprint == 0 || (oldest->fingerprint != 0 && entry->seen < oldest->seen)){
+      oldest = entry;
+    }
+  }
+
+  oldest->fingerprint = print;
+  oldest->seen = now;
+  return false;
+}
+
+//
+// Response
+//
+
+/**
+ * Response-PDU for an inform: same version, community, request-id and varbinds, no error.
+ *   Written back to front into buffer, returns where it starts and sets size.
+ *   Varbinds that don't fit are left out, the manager only needs the request-id.
+ */
+static const byte *build_response(const RECEIVED_NOTIFICATION *n, byte *buffer, uint16_t capacity, uint16_t *size){
+  SNMP_BER_WRITER writer;
+
+  for(byte attempt = 0; attempt < 2; attempt++){
+    writer.begin(buffer, capacity);
+
+    if(attempt == 0){
+      writer.push(n->varbind_list.data, n->varbind_list.size);
+    }else{
+      writer.push_header(SNMP_SYNTAX_SEQUENCE, 0);
+    }
+    writer.push_integer(SNMP_SYNTAX_INT, 0);//error-index
+    writer.push_integer(SNMP_SYNTAX_INT, 0);//error-status
+    writer.push_integer(SNMP_SYNTAX_INT, n->request_id);
+    writer.close(SNMP_PDU_RESPONSE, 0);
+    writer.push(n->community.data, n->community.size);
+    writer.push_header(SNMP_SYNTAX_OCTETS, n->community.size);
+    writer.push_integer(SNMP_SYNTAX_INT, n->version);
+    writer.close(SNMP_SYNTAX_SEQUENCE, 0);
+
+    if(writer.overflow == false){
+      break;
+    }
+  }
+
+  *size = writer.size();
+  return writer.data();
+}
+
+//
+// Log
+//
+
+static void log_flush(){
+  uint32_t done = 0;
+
+  while(output.fd >= 0 && done < output.used){
+    ssize_t n = write(output.fd, output.buffer + done, output.used - done);
+    if(n <= 0){
+      if(n < 0 && errno == EINTR){
+        continue;
+      }
+      break;
+    }
+    done += n;
+  }
+  output.used = 0;
+}
+
+//room for at least size more characters
+static char *log_reserve(uint32_t size){
+  if(output.used + size > RECEIVER_LOG_LEN){
+    log_flush();
+  }
+  return output.buffer + output.used;
+}
+
+static void log_text(const char *text, uint32_t size){
+  memcpy(log_reserve(size), text, size);
+  output.used += size;
+}
+
+static void log_unsigned(uint64_t value){
+  char digits[20];
+  byte count = 0;
+  char *p = log_reserve(21);
+
+  do{
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  }while(value != 0);
+  while(count > 0){
+    *p++ = digits[--count];
+  }
+  output.used = p - output.buffer;
+}
+
+static void log_integer(int32_t value){
+  if(value < 0){
+    log_text("-", 1);
+    log_unsigned(-(int64_t)value);
+  }else{
+    log_unsigned(value);
+  }
+}
+
+static void log_hex(const byte *data, uint16_t size){
+  static const char hex[] = "0123456789abcdef";
+  char *p = log_reserve(2 * size + 2);
+
+  *p++ = '0';
+  *p++ = 'x';
+  for(uint16_t i = 0; i < size; i++){
+    *p++ = hex[data[i] >> 4];
+    *p++ = hex[data[i] & 0x0F];
+  }
+  output.used = p - output.buffer;
+}
+
+//OID contents through SNMP_OID, hex if it has more arcs than SNMP_MAX_OID_LEN
+static void log_oid(const SNMP_BER_VIEW &view){
+  if(view.size == 0 || view.size > 255 || scratch_oid.decode(view.data, view.size) != SNMP_API_STAT_SUCCESS){
+    log_hex(view.data, view.size);
+    return;
+  }
+  output.used += scratch_oid.toString(log_reserve(SNMP_MAX_OID_LEN * 11 + 1), SNMP_MAX_OID_LEN * 11 + 1);
+}
+
+//printable strings quoted with " and \ escaped, anything else in hex
+static void log_string(const SNMP_BER_VIEW &view){
+  for(uint16_t i = 0; i < view.size; i++){
+    if(view.data[i] < 0x20 || view.data[i] > 0x7E){
+      log_hex(view.data, view.size);
+      return;
+    }
+  }
+
+  char *p = log_reserve(2 * view.size + 2);
+  *p++ = '"';
+  for(uint16_t i = 0; i < view.size; i++){
+    if(view.data[i] == '"' || view.data[i] == '\\'){
+      *p++ = '\\';
+    }
+    *p++ = view.data[i];
+  }
+  *p++ = '"';
+  output.used = p - output.buffer;
+}
+
+//numbers are decoded by SNMP_VALUE, the same code the agents use
+static void log_value(byte tag, const SNMP_BER_VIEW &view){
+  int32_t integer;
+  uint64_t number;
+
+  scratch_value.syntax = (SNMP_SYNTAXES)tag;
+  scratch_value.size = view.size <= SNMP_MAX_VALUE_LEN ? view.size : 0;
+  memcpy(scratch_value.data, view.data, scratch_value.size);
+
+  switch(tag){
+    case SNMP_SYNTAX_INT:
+      if(view.size <= 4 && scratch_value.decode(&integer) == SNMP_ERR_NO_ERROR){
+        log_integer(integer);
+        return;
+      }
+      break;
+    case SNMP_SYNTAX_COUNTER:
+    case SNMP_SYNTAX_GAUGE:
+    case SNMP_SYNTAX_TIME_TICKS:
+    case SNMP_SYNTAX_UINT32:
+    case SNMP_SYNTAX_COUNTER64:
+      if(view.size <= 9 && scratch_value.decode(&number) == SNMP_ERR_NO_ERROR){
+        log_unsigned(number);
+        return;
+      }
+      break;
+    case SNMP_SYNTAX_OCTETS:
+      log_string(view);
+      return;
+    case SNMP_SYNTAX_OID:
+      log_oid(view);
+      return;
+    case SNMP_SYNTAX_IP_ADDRESS:
+      if(view.size == 4){
+        for(byte i = 0; i < 4; i++){
+          if(i != 0){
+            log_text(".", 1);
+          }
+          log_unsigned(view.data[i]);
+        }
+        return;
+      }
+      break;
+    case SNMP_SYNTAX_NULL:
+      log_text("null", 4);
+      return;
+    case 0x80:
+      log_text("noSuchObject", 12);
+      return;
+    case 0x81:
+      log_text("noSuchInstance", 14);
+      return;
+    case 0x82:
+      log_text("endOfMibView", 12);
+      return;
+  }
+
+  log_hex(view.data, view.size);
+}
+
+/**
+ * time sender type request-id community, then oid=value for each varbind.
+ *   sysUpTime.0 and snmpTrapOID.0 are written as uptime= and trap=.
+ */
+static void log_notification(const RECEIVED_NOTIFICATION *n, uint32_t address, uint16_t port){
+  SNMP_BER_VIEW varbind, oid, value;
+  uint16_t pos = 0, vb_pos;
+  byte tag, value_tag;
+  byte ip[4];
+
+  memcpy(ip, &address, 4);
+
+  log_text(output.stamp, strlen(output.stamp));
+  for(byte i = 0; i < 4; i++){
+    log_unsigned(ip[i]);
+    log_text(i == 3 ? ":" : ".", 1);
+  }
+  log_unsigned(ntohs(port));
+  if(n->type == SNMP_PDU_INFORM_REQUEST){
+    log_text(" INFORM id=", 11);
+  }else{
+    log_text(" TRAP id=", 9);
+  }
+  log_integer(n->request_id);
+  log_text(" community=", 11);
+  log_string(n->community);
+
+  while(pos < n->varbinds.size){
+    if(read_tlv(n->varbinds.data, n->varbinds.size, &pos, &tag, &varbind) == false || tag != SNMP_SYNTAX_SEQUENCE){
+      log_text(" malformed", 10);
+      break;
+    }
+
+    vb_pos = 0;
+    if(read_tlv(varbind.data, varbind.size, &vb_pos, &tag, &oid) == false || tag != SNMP_SYNTAX_OID
+        || read_tlv(varbind.data, varbind.size, &vb_pos, &value_tag, &value) == false){
+      log_text(" malformed", 10);
+      break;
+    }
+
+    //the constants include syntax and length
+    if(oid.equals(SNMP_SYS_UP_TIME_OID + 2, sizeof(SNMP_SYS_UP_TIME_OID) - 2)){
+      log_text(" uptime=", 8);
+    }else if(oid.equals(SNMP_TRAP_OID_OID + 2, sizeof(SNMP_TRAP_OID_OID) - 2)){
+      log_text(" trap=", 6);
+    }else{
+      log_text(" ", 1);
+      log_oid(oid);
+      log_text("=", 1);
+    }
+    log_value(value_tag, value);
+  }
+
+  log_text("\n", 1);
+}
+
+static uint64_t wall_clock_ms(){
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+//UTC with milliseconds, once per batch
+static void log_stamp(uint64_t time){
+  struct tm utc;
+  time_t seconds = time / 1000;
+
+  gmtime_r(&seconds, &utc);
+  size_t length = strftime(output.stamp, sizeof(output.stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+  snprintf(output.stamp + length, sizeof(output.stamp) - length, ".%03dZ ", (int)(time % 1000));
+}
+
+//
+// Pipeline
+//
+
+/**
+ * Everything done for one datagram. Returns the response to send back, NULL if there is none.
+ */
+static const byte *handle_datagram(const byte *packet, uint16_t size, uint32_t address, uint16_t port, uint32_t now,
+                                   byte *response_buffer, uint16_t *response_size){
+  RECEIVED_NOTIFICATION n;
+  const byte *response = NULL;
+
+  stats.datagrams++;
+
+  switch(decode_notification(packet, size, &n)){
+    case RECEIVE_INVALID:
+      stats.invalid++;
+      return NULL;
+    case RECEIVE_IGNORED:
+      stats.ignored++;
+      return NULL;
+    default:
+      break;
+  }
+
+  if(accepted_community != NULL && n.community.equals((const byte*)accepted_community, strlen(accepted_community)) == false){
+    stats.wrong_community++;
+    return NULL;
+  }
+
+  if(n.type == SNMP_PDU_INFORM_REQUEST){
+    response = build_response(&n, response_buffer, RECEIVER_DATAGRAM_LEN, response_size);
+    stats.responses++;
+  }
+
+  if(seen_before(fingerprint(address, port, n.pdu), now)){
+    stats.duplicates++;
+    return response;
+  }
+
+  stats.notifications++;
+  if(n.type == SNMP_PDU_INFORM_REQUEST){
+    stats.informs++;
+  }
+  if(output.enabled){
+    log_notification(&n, address, port);
+  }
+  if(store != NULL){
+    store_append(store, batch_time, address, port, packet, size);
+  }
+
+  return response;
+}
+
+static uint32_t seconds(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec;
+}
+
+static void print_stats(double elapsed){
+  fprintf(stderr, "datagrams %llu, notifications %llu (informs %llu), duplicates %llu, responses %llu, invalid %llu, ignored %llu, wrong community %llu\n",
+    (unsigned long long)stats.datagrams, (unsigned long long)stats.notifications, (unsigned long long)stats.informs,
+    (unsigned long long)stats.duplicates, (unsigned long long)stats.responses, (unsigned long long)stats.invalid,
+    (unsigned long long)stats.ignored, (unsigned long long)stats.wrong_community);
+  if(elapsed > 0){
+    fprintf(stderr, "%.3f s, %.0f datagrams/s\n", elapsed, stats.datagrams / elapsed);
+  }
+}
+
+static void stop(int){
+  stopping = 1;
+}
+
+static int receive(uint16_t port){
+  static byte datagrams[RECEIVER_BATCH][RECEIVER_DATAGRAM_LEN];
+  static byte responses[RECEIVER_BATCH][RECEIVER_DATAGRAM_LEN];
+  struct mmsghdr in[RECEIVER_BATCH], out[RECEIVER_BATCH];
+  struct iovec in_iov[RECEIVER_BATCH], out_iov[RECEIVER_BATCH];
+  struct sockaddr_in from[RECEIVER_BATCH];
+  struct sockaddr_in local;
+  int fd, size = 4 << 20;
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if(fd < 0){
+    perror("socket");
+    return 1;
+  }
+
+  //bursts during outages arrive faster than one batch is handled
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(fd, (struct sockaddr*)&local, sizeof(local)) != 0){
+    perror("bind");
+    return 1;
+  }
+
+  for(int i = 0; i < RECEIVER_BATCH; i++){
+    in_iov[i].iov_base = datagrams[i];
+    in_iov[i].iov_len = RECEIVER_DATAGRAM_LEN;
+    memset(&in[i], 0, sizeof(in[i]));
+    in[i].msg_hdr.msg_iov = &in_iov[i];
+    in[i].msg_hdr.msg_iovlen = 1;
+    in[i].msg_hdr.msg_name = &from[i];
+  }
+
+  while(stopping == 0){
+    for(int i = 0; i < RECEIVER_BATCH; i++){
+      in[i].msg_hdr.msg_namelen = sizeof(from[i]);
+    }
+
+    //blocks for the first datagram only, then takes whatever else is queued
+    int count = recvmmsg(fd, in, RECEIVER_BATCH, MSG_WAITFORONE, NULL);
+    if(count < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      perror("recvmmsg");
+      break;
+    }
+
+    uint32_t now = seconds();
+    int replies = 0;
+    batch_time = wall_clock_ms();
+    log_stamp(batch_time);
+
+    for(int i = 0; i < count; i++){
+      uint16_t response_size;
+      const byte *response;
+
+      if(in[i].msg_hdr.msg_flags & MSG_TRUNC){
+        stats.datagrams++;
+        stats.invalid++;
+        continue;
+      }
+
+      response = handle_datagram(datagrams[i], in[i].msg_len, from[i].sin_addr.s_addr, from[i].sin_port, now,
+                                 responses[replies], &response_size);
+      if(response != NULL){
+        out_iov[replies].iov_base = (void*)response;
+        out_iov[replies].iov_len = response_size;
+        memset(&out[replies], 0, sizeof(out[replies]));
+        out[replies].msg_hdr.msg_iov = &out_iov[replies];
+        out[replies].msg_hdr.msg_iovlen = 1;
+        out[replies].msg_hdr.msg_name = &from[i];
+        out[replies].msg_hdr.msg_namelen = sizeof(from[i]);
+        replies++;
+      }
+    }
+
+    for(int sent = 0; sent < replies; ){
+      int n = sendmmsg(fd, out + sent, replies - sent, 0);
+      if(n <= 0){
+        if(n < 0 && errno == EINTR){
+          continue;
+        }
+        break;
+      }
+      sent += n;
+    }
+
+    log_flush();
+    if(store != NULL){
+      store_flush(store);
+    }
+  }
+
+  log_flush();
+  if(store != NULL){
+    store_close(store);
+  }
+  print_stats(0);
+  close(fd);
+  return 0;
+}
+
+//
+// Benchmark corpus
+//
+
+typedef struct CORPUS {
+  byte *data;
+  uint32_t *offsets;//count + 1 entries
+  uint32_t *addresses;
+  uint16_t *ports;
+  uint32_t count;
+};
+
+static uint64_t random_state;
+
+static uint32_t next_random(){
+  //xorshift64*, the same seed gives the same corpus on every host
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return (random_state * 2685821657736338717ULL) >> 32;
+}
+
+/**
+ * Notifications like the agents send: sysUpTime.0, snmpTrapOID.0 and 1 to 8 objects of mixed syntax,
+ * informs and traps from 4096 agents. About 10% repeat an earlier notification from the same agent.
+ *   Encoded with SNMP_BER_WRITER, back to front.
+ */
+static void build_corpus(CORPUS *corpus, uint32_t count, uint64_t seed){
+  static const char *const STRINGS[] = {"Door open", "Temperature high", "Power restored", "Generator running", "Link down on port 4"};
+  byte buffer[1024];
+  SNMP_BER_WRITER writer;
+  SNMP_OID oid;
+  uint32_t capacity = count * 160 + 1024;
+  uint32_t used = 0;
+  uint32_t agent_ids[4096];
+
+  random_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  corpus->data = (byte*)malloc(capacity);
+  corpus->offsets = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+  corpus->addresses = (uint32_t*)malloc(count * sizeof(uint32_t));
+  corpus->ports = (uint16_t*)malloc(count * sizeof(uint16_t));
+  corpus->count = count;
+  memset(agent_ids, 0, sizeof(agent_ids));
+
+  for(uint32_t i = 0; i < count; i++){
+    corpus->offsets[i] = used;
+
+    //a retransmission, same bytes from the same agent
+    if(i > 16 && next_random() % 10 == 0){
+      uint32_t original = i - 1 - next_random() % (i < 1000 ? i - 1 : 1000);
+      uint32_t size = corpus->offsets[original + 1] - corpus->offsets[original];
+
+      if(used + size > capacity){
+        capacity = capacity * 2;
+        corpus->data = (byte*)realloc(corpus->data, capacity);
+      }
+      memcpy(corpus->data + used, corpus->data + corpus->offsets[original], size);
+      corpus->addresses[i] = corpus->addresses[original];
+      corpus->ports[i] = corpus->ports[original];
+      used += size;
+      continue;
+    }
+
+    uint32_t agent = next_random() % 4096;
+    boolean inform = next_random() % 10 < 6;
+    byte objects = 1 + next_random() % 8;
+
+    writer.begin(buffer, sizeof(buffer));
+
+    for(byte o = objects; o > 0; o--){
+      uint16_t m = writer.mark();
+      uint32_t r = next_random();
+
+      switch(r % 6){
+        case 0:
+          writer.push_integer(SNMP_SYNTAX_INT, (int32_t)next_random());
+          break;
+        case 1: {
+          const char *text = STRINGS[next_random() % 5];
+          writer.push((const byte*)text, strlen(text));
+          writer.push_header(SNMP_SYNTAX_OCTETS, strlen(text));
+          break;
+        }
+        case 2:
+          writer.push_unsigned(SNMP_SYNTAX_COUNTER, next_random());
+          break;
+        case 3:
+          writer.push_unsigned64(SNMP_SYNTAX_COUNTER64, ((uint64_t)next_random() << 32) | next_random());
+          break;
+        case 4: {
+          uint32_t ip = next_random();
+          writer.push((const byte*)&ip, 4);
+          writer.push_header(SNMP_SYNTAX_IP_ADDRESS, 4);
+          break;
+        }
+        default:
+          writer.push_unsigned(SNMP_SYNTAX_GAUGE, next_random() % 1000);
+          break;
+      }
+
+      oid.fromString("1.3.6.1.4.1.12345.1.2.2");
+      oid.data[oid.size++] = o;
+      oid.data[oid.size++] = r % 64;
+      oid.encode(&writer);
+      writer.close(SNMP_SYNTAX_SEQUENCE, m);
+    }
+
+    //snmpTrapOID.0
+    uint16_t m = writer.mark();
+    oid.fromString("1.3.6.1.4.1.12345.1.2.1");
+    oid.data[oid.size++] = 1 + next_random() % 5;
+    oid.encode(&writer);
+    writer.push(SNMP_TRAP_OID_OID, sizeof(SNMP_TRAP_OID_OID));
+    writer.close(SNMP_SYNTAX_SEQUENCE, m);
+
+    //sysUpTime.0
+    m = writer.mark();
+    writer.push_unsigned(SNMP_SYNTAX_TIME_TICKS, next_random());
+    writer.push(SNMP_SYS_UP_TIME_OID, sizeof(SNMP_SYS_UP_TIME_OID));
+    writer.close(SNMP_SYNTAX_SEQUENCE, m);
+
+    writer.close(SNMP_SYNTAX_SEQUENCE, 0);
+    writer.push_integer(SNMP_SYNTAX_INT, 0);
+    writer.push_integer(SNMP_SYNTAX_INT, 0);
+    writer.push_integer(SNMP_SYNTAX_INT, ++agent_ids[agent]);
+    writer.close(inform ? SNMP_PDU_INFORM_REQUEST : SNMP_PDU_TRAP2, 0);
+    writer.push((const byte*)"public", 6);
+    writer.push_header(SNMP_SYNTAX_OCTETS, 6);
+    writer.push_integer(SNMP_SYNTAX_INT, 1);
+    writer.close(SNMP_SYNTAX_SEQUENCE, 0);
+
+    if(used + writer.size() > capacity){
+      capacity = capacity * 2;
+      corpus->data = (byte*)realloc(corpus->data, capacity);
+    }
+    memcpy(corpus->data + used, writer.data(), writer.size());
+    used += writer.size();
+    corpus->addresses[i] = htonl(0x0A000000 | (agent << 8) | 1);//10.0.x.y
+    corpus->ports[i] = htons(161);
+  }
+
+  corpus->offsets[count] = used;
+}
+
+static double elapsed_since(const struct timespec &start){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static int bench(uint32_t count, uint64_t seed){
+  static byte response[RECEIVER_DATAGRAM_LEN];
+  CORPUS corpus;
+  struct timespec start;
+  uint16_t response_size;
+  uint64_t response_bytes = 0;
+
+  build_corpus(&corpus, count, seed);
+  fprintf(stderr, "corpus: %u datagrams, %u bytes, seed %llu\n", count, corpus.offsets[count], (unsigned long long)seed);
+
+  uint64_t first_time = wall_clock_ms() - 4ULL * count;
+  log_stamp(first_time);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for(uint32_t i = 0; i < count; i++){
+    uint32_t offset = corpus.offsets[i];
+    batch_time = first_time + 4ULL * i;
+    const byte *reply = handle_datagram(corpus.data + offset, corpus.offsets[i+1] - offset, corpus.addresses[i], corpus.ports[i], 0,
+                                        response, &response_size);
+    if(reply != NULL){
+      response_bytes += response_size;
+    }
+  }
+  log_flush();
+  if(store != NULL){
+    store_close(store);
+  }
+
+  print_stats(elapsed_since(start));
+  fprintf(stderr, "response bytes %llu\n", (unsigned long long)response_bytes);
+  return 0;
+}
+
+//
+// Store queries
+//
+
+/**
+ * 2026-01-31T12:00[:00] in UTC, seconds since 1970, or an offset from now like -15m.
+ */
+static boolean parse_time(const char *text, uint64_t now, uint64_t *time){
+  char *end;
+
+  if(text[0] == '-'){
+    uint64_t amount = strtoull(text + 1, &end, 10);
+    uint64_t unit = *end == 's' ? 1 : *end == 'm' ? 60 : *end == 'h' ? 3600 : *end == 'd' ? 86400 : 0;
+
+    if(end == text + 1 || unit == 0 || end[1] != '\0' || amount * unit * 1000 > now){
+      return false;
+    }
+    *time = now - amount * unit * 1000;
+    return true;
+  }
+
+  if(strchr(text, 'T') != NULL){
+    struct tm utc;
+
+    memset(&utc, 0, sizeof(utc));
+    end = strptime(text, "%Y-%m-%dT%H:%M", &utc);
+    if(end != NULL && *end == ':'){
+      end = strptime(end + 1, "%S", &utc);
+    }
+    if(end == NULL || (*end != '\0' && strcmp(end, "Z") != 0)){
+      return false;
+    }
+    *time = (uint64_t)timegm(&utc) * 1000;
+    return true;
+  }
+
+  *time = strtoull(text, &end, 10) * 1000;
+  return end != text && *end == '\0';
+}
+
+//a.b.c.d or a.b.c.d/bits, as a host order range
+static boolean parse_source(const char *text, uint32_t *low, uint32_t *high){
+  char address[INET_ADDRSTRLEN];
+  const char *slash = strchr(text, '/');
+  size_t length = slash ? (size_t)(slash - text) : strlen(text);
+  unsigned long bits = slash ? strtoul(slash + 1, NULL, 10) : 32;
+  struct in_addr parsed;
+
+  if(length >= sizeof(address) || bits > 32){
+    return false;
+  }
+  memcpy(address, text, length);
+  address[length] = '\0';
+  if(inet_pton(AF_INET, address, &parsed) != 1){
+    return false;
+  }
+
+  uint32_t mask = bits == 0 ? 0 : 0xFFFFFFFFU << (32 - bits);
+  *low = ntohl(parsed.s_addr) & mask;
+  *high = *low | ~mask;
+  return true;
+}
+
+static void log_stored(const STORE_RECORD *record, const byte *datagram, void *){
+  RECEIVED_NOTIFICATION n;
+
+  if(output.enabled && decode_notification(datagram, record->size, &n) == RECEIVE_NOTIFICATION){
+    log_stamp(record->time);
+    log_notification(&n, record->address, record->port);
+  }
+}
+
+static int query(const char *directory, const char *from, const char *to, const char *source){
+  uint64_t now = wall_clock_ms();
+  STORE_QUERY range;
+  struct timespec start;
+
+  range.from = 0;
+  range.to = UINT64_MAX;
+  range.low = 0;
+  range.high = 0xFFFFFFFF;
+
+  if((from != NULL && parse_time(from, now, &range.from) == false) || (to != NULL && parse_time(to, now, &range.to) == false)){
+    fprintf(stderr, "times are 2026-01-31T12:00:00, seconds since 1970 or -15m\n");
+    return 2;
+  }
+  if(source != NULL && parse_source(source, &range.low, &range.high) == false){
+    fprintf(stderr, "bad source %s\n", source);
+    return 2;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint64_t matches = store_query(directory, &range, log_stored, NULL);
+  log_flush();
+
+  fprintf(stderr, "%llu notifications in %.3f ms\n", (unsigned long long)matches, elapsed_since(start) * 1000);
+  return 0;
+}
+
+static int flood(const char *target, uint32_t count, uint64_t seed){
+  struct mmsghdr messages[RECEIVER_BATCH];
+  struct iovec iov[RECEIVER_BATCH];
+  struct sockaddr_in to;
+  struct timespec start;
+  char host[64];
+  const char *colon = strrchr(target, ':');
+  CORPUS corpus;
+  uint32_t sent = 0;
+  int fd;
+
+  if(colon == NULL || colon - target >= (long)sizeof(host)){
+    fprintf(stderr, "--flood needs host:port\n");
+    return 1;
+  }
+  memcpy(host, target, colon - target);
+  host[colon - target] = '\0';
+  memset(&to, 0, sizeof(to));
+  to.sin_family = AF_INET;
+  to.sin_port = htons(atoi(colon + 1));
+  if(inet_pton(AF_INET, host, &to.sin_addr) != 1){
+    fprintf(stderr, "bad address %s\n", host);
+    return 1;
+  }
+
+  build_corpus(&corpus, count, seed);
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while(sent < count){
+    int batch = count - sent < RECEIVER_BATCH ? count - sent : RECEIVER_BATCH;
+
+    for(int i = 0; i < batch; i++){
+      uint32_t offset = corpus.offsets[sent + i];
+      iov[i].iov_base = corpus.data + offset;
+      iov[i].iov_len = corpus.offsets[sent + i + 1] - offset;
+      memset(&messages[i], 0, sizeof(messages[i]));
+      messages[i].msg_hdr.msg_iov = &iov[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+      messages[i].msg_hdr.msg_name = &to;
+      messages[i].msg_hdr.msg_namelen = sizeof(to);
+    }
+
+    int n = sendmmsg(fd, messages, batch, 0);
+    if(n < 0){
+      if(errno == EINTR || errno == ENOBUFS){
+        continue;
+      }
+      perror("sendmmsg");
+      break;
+    }
+    sent += n;
+  }
+
+  double elapsed = elapsed_since(start);
+  fprintf(stderr, "sent %u datagrams in %.3f s, %.0f/s\n", sent, elapsed, sent / elapsed);
+  close(fd);
+  return 0;
+}
+
+int main(int argc, char **argv){
+  uint16_t port = SNMP_MANAGER_PORT;
+  uint32_t bench_count = 0;
+  const char *flood_target = NULL;
+  const char *log_file = NULL;
+  const char *store_directory = NULL;
+  const char *query_directory = NULL;
+  const char *from = NULL, *to = NULL, *source = NULL;
+  uint64_t seed = 1;
+  boolean quiet = false;
+
+  for(int i = 1; i < argc; i++){
+    boolean has_value = i + 1 < argc;
+
+    if(strcmp(argv[i], "-p") == 0 && has_value){
+      port = atoi(argv[++i]);
+    }else if(strcmp(argv[i], "-c") == 0 && has_value){
+      accepted_community = argv[++i];
+    }else if(strcmp(argv[i], "-o") == 0 && has_value){
+      log_file = argv[++i];
+    }else if(strcmp(argv[i], "-j") == 0 && has_value){
+      store_directory = argv[++i];
+    }else if(strcmp(argv[i], "-w") == 0 && has_value){
+      dedup_window = strtoul(argv[++i], NULL, 10);
+    }else if(strcmp(argv[i], "-q") == 0){
+      quiet = true;
+    }else if(strcmp(argv[i], "--bench") == 0 && has_value){
+      bench_count = strtoul(argv[++i], NULL, 10);
+    }else if(strcmp(argv[i], "--flood") == 0 && i + 2 < argc){
+      flood_target = argv[++i];
+      bench_count = strtoul(argv[++i], NULL, 10);
+    }else if(strcmp(argv[i], "--seed") == 0 && has_value){
+      seed = strtoull(argv[++i], NULL, 10);
+    }else if(strcmp(argv[i], "--query") == 0 && has_value){
+      query_directory = argv[++i];
+    }else if(strcmp(argv[i], "--from") == 0 && has_value){
+      from = argv[++i];
+    }else if(strcmp(argv[i], "--to") == 0 && has_value){
+      to = argv[++i];
+    }else if(strcmp(argv[i], "--source") == 0 && has_value){
+      source = argv[++i];
+    }else if(strcmp(argv[i], "--count") == 0){
+      quiet = true;
+    }else{
+      fprintf(stderr, "usage: %s [-p port] [-c community] [-o log_file] [-j store_dir] [-w dedup_seconds] [-q]\n"
+                      "       %s --bench count [--seed n] [-o log_file] [-j store_dir] [-q]\n"
+                      "       %s --flood host:port count [--seed n]\n"
+                      "       %s --query store_dir [--from time] [--to time] [--source address[/bits]] [--count]\n",
+                      argv[0], argv[0], argv[0], argv[0]);
+      return 2;
+    }
+  }
+
+  if(flood_target != NULL){
+    return flood(flood_target, bench_count, seed);
+  }
+
+  output.enabled = !quiet;
+  output.fd = STDOUT_FILENO;
+  if(log_file != NULL){
+    output.fd = open(log_file, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(output.fd < 0){
+      perror(log_file);
+      return 1;
+    }
+  }else if(bench_count != 0){
+    //the benchmark formats every line, it only writes them when asked to
+    output.fd = -1;
+  }
+
+  if(query_directory != NULL){
+    return query(query_directory, from, to, source);
+  }
+
+  if(store_directory != NULL){
+    store = (TRAP_STORE*)malloc(sizeof(TRAP_STORE));
+    if(store == NULL || store_open(store, store_directory) == false){
+      return 1;
+    }
+  }
+
+  dedup = (DEDUP_ENTRY*)calloc(DEDUP_SLOTS, sizeof(DEDUP_ENTRY));
+  if(dedup == NULL){
+    perror("calloc");
+    return 1;
+  }
+
+  if(bench_count != 0){
+    return bench(bench_count, seed);
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop;//no SA_RESTART, recvmmsg returns EINTR
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  return receive(port);
+}
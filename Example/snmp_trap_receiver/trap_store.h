@@ -0,0 +1,559 @@
+/**
+ * Append-only notification store for snmp_trap_receiver.
+ * Copyright (C) 2013 Rex Park <rex.park@me.com>
+ * All rights reserved.
+ *
+ * A directory of numbered segment files. The receiver appends each notification as it arrives, with sequential
+ * writes only. When a segment reaches STORE_SEGMENT_LEN bytes or spans STORE_SEGMENT_SPAN_MS it is sealed:
+ * two indexes and a footer are appended and the next segment is started.
+ *
+ * Segment layout, host byte order (the files are read where they are written):
+ *   STORE_FILE_HEADER
+ *   records: STORE_RECORD followed by the datagram as received, padded to 8 bytes
+ *   time index: STORE_INDEX_ENTRY for each record, by time
+ *   source index: the same entries, by source address and then time
+ *   STORE_FOOTER
+ *
+ * Queries mmap() the segments. The footer alone decides whether a segment can hold anything in the time range,
+ * the indexes are binary searched. A segment without a footer (the one being written, or one left by a crash)
+ * is scanned record by record. store_open() seals those left by a crash, dropping a torn last record.
+ */
+#ifndef TRAP_STORE_H
+#define TRAP_STORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef STORE_SEGMENT_LEN
+#define STORE_SEGMENT_LEN     (64UL << 20)        //record bytes before a segment is sealed
+#endif
+#ifndef STORE_SEGMENT_SPAN_MS
+#define STORE_SEGMENT_SPAN_MS (3600UL * 1000)     //longest time a segment covers, keeps time pruning useful
+#endif
+#ifndef STORE_WRITE_BUFFER_LEN
+#define STORE_WRITE_BUFFER_LEN (1 << 20)
+#endif
+
+#define STORE_MAGIC        "SNMPSEG1"
+#define STORE_FOOTER_MAGIC "SNMPEND1"
+#define STORE_VERSION      1
+#define STORE_PATH_LEN     512
+
+typedef struct STORE_FILE_HEADER {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+typedef struct STORE_RECORD {
+  uint64_t time;//ms since 1970, UTC
+  uint32_t address;//network order, as in sockaddr_in
+  uint16_t port;//network order
+  uint16_t size;//datagram bytes
+};
+
+typedef struct STORE_INDEX_ENTRY {
+  uint64_t time;
+  uint32_t address;//host order so prefixes are ranges
+  uint32_t offset;//of the STORE_RECORD
+};
+
+typedef struct STORE_FOOTER {
+  char magic[8];
+  uint64_t first_time;
+  uint64_t last_time;
+  uint64_t index_offset;//time index, the source index follows it
+  uint32_t count;
+  uint32_t reserved;
+};
+
+typedef struct TRAP_STORE {
+  char directory[STORE_PATH_LEN];
+  int fd;//-1 when closed
+  uint32_t sequence;//of the segment being written
+  uint64_t size;//bytes in the segment, including the buffer
+  uint64_t first_time;
+  STORE_INDEX_ENTRY *entries;
+  uint32_t count;
+  uint32_t capacity;
+  uint32_t buffered;
+  byte buffer[STORE_WRITE_BUFFER_LEN];
+};
+
+/**
+ * Records and indexes ask for the same thing: all notifications in [from, to] whose source is in [low, high].
+ */
+typedef struct STORE_QUERY {
+  uint64_t from;
+  uint64_t to;
+  uint32_t low;//host order
+  uint32_t high;
+};
+
+//called for every matching record, in time order within a segment and segment order across them
+typedef void (*STORE_VISITOR)(const STORE_RECORD *record, const byte *datagram, void *context);
+
+static uint32_t store_padded(uint32_t size){
+  return (size + 7) & ~7U;
+}
+
+//false if the name doesn't fit in STORE_PATH_LEN
+static boolean store_path(char *path, const char *directory, uint32_t sequence){
+  int length = snprintf(path, STORE_PATH_LEN, "%s/%010u.seg", directory, sequence);
+
+  return length > 0 && length < STORE_PATH_LEN;
+}
+
+static boolean store_write(int fd, const void *data, size_t size){
+  const byte *p = (const byte*)data;
+
+  while(size > 0){
+    ssize_t n = write(fd, p, size);
+    if(n < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static int store_by_time(const void *a, const void *b){
+  const STORE_INDEX_ENTRY *x = (const STORE_INDEX_ENTRY*)a, *y = (const STORE_INDEX_ENTRY*)b;
+
+  if(x->time != y->time){
+    return x->time < y->time ? -1 : 1;
+  }
+  return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static int store_by_source(const void *a, const void *b){
+  const STORE_INDEX_ENTRY *x = (const STORE_INDEX_ENTRY*)a, *y = (const STORE_INDEX_ENTRY*)b;
+
+  if(x->address != y->address){
+    return x->address < y->address ? -1 : 1;
+  }
+  return store_by_time(a, b);
+}
+
+static boolean store_add_entry(STORE_INDEX_ENTRY **entries, uint32_t *count, uint32_t *capacity, uint64_t time, uint32_t address, uint32_t offset){
+  if(*count == *capacity){
+    uint32_t grown = *capacity ? *capacity * 2 : 65536;
+    STORE_INDEX_ENTRY *larger = (STORE_INDEX_ENTRY*)realloc(*entries, grown * sizeof(STORE_INDEX_ENTRY));
+
+    if(larger == NULL){
+      return false;
+    }
+    *entries = larger;
+    *capacity = grown;
+  }
+
+  (*entries)[*count].time = time;
+  (*entries)[*count].address = ntohl(address);
+  (*entries)[*count].offset = offset;
+  (*count)++;
+  return true;
+}
+
+/**
+ * Appends both indexes and the footer to a segment whose records end at size.
+ *   The indexes are on disk before the footer that makes them valid.
+ */
+static boolean store_seal(int fd, uint64_t size, STORE_INDEX_ENTRY *entries, uint32_t count){
+  STORE_FOOTER footer;
+
+  qsort(entries, count, sizeof(STORE_INDEX_ENTRY), store_by_time);
+
+  memset(&footer, 0, sizeof(footer));
+  memcpy(footer.magic, STORE_FOOTER_MAGIC, 8);
+  footer.index_offset = size;
+  footer.count = count;
+  if(count > 0){
+    footer.first_time = entries[0].time;
+    footer.last_time = entries[count - 1].time;
+  }
+
+  if(lseek(fd, size, SEEK_SET) < 0 || store_write(fd, entries, count * sizeof(STORE_INDEX_ENTRY)) == false){
+    return false;
+  }
+  qsort(entries, count, sizeof(STORE_INDEX_ENTRY), store_by_source);
+  if(store_write(fd, entries, count * sizeof(STORE_INDEX_ENTRY)) == false || fdatasync(fd) != 0){
+    return false;
+  }
+
+  return store_write(fd, &footer, sizeof(footer)) && fdatasync(fd) == 0;
+}
+
+//footer of a sealed segment that is size bytes long, false for anything else
+static boolean store_read_footer(int fd, uint64_t size, STORE_FOOTER *footer){
+  if(size < sizeof(STORE_FILE_HEADER) + sizeof(STORE_FOOTER) || pread(fd, footer, sizeof(*footer), size - sizeof(*footer)) != sizeof(*footer)){
+    return false;
+  }
+
+  return memcmp(footer->magic, STORE_FOOTER_MAGIC, 8) == 0
+      && footer->index_offset + 2ULL * footer->count * sizeof(STORE_INDEX_ENTRY) + sizeof(*footer) == size;
+}
+
+/**
+ * Walks the records of an unsealed segment, returns where the last complete one ends.
+ *   A record that runs past the end, or is still zeros, ends the walk.
+ */
+static uint64_t store_scan(const byte *map, uint64_t size, const STORE_QUERY *query, STORE_VISITOR visit, void *context, uint64_t *matches,
+                           STORE_INDEX_ENTRY **entries, uint32_t *count, uint32_t *capacity){
+  uint64_t offset = sizeof(STORE_FILE_HEADER);
+
+  while(offset + sizeof(STORE_RECORD) <= size){
+    const STORE_RECORD *record = (const STORE_RECORD*)(map + offset);
+    uint64_t next = offset + sizeof(STORE_RECORD) + store_padded(record->size);
+
+    if(record->time == 0 || record->size == 0 || next > size){
+      break;
+    }
+
+    if(visit != NULL){
+      uint32_t address = ntohl(record->address);
+      if(record->time >= query->from && record->time <= query->to && address >= query->low && address <= query->high){
+        visit(record, (const byte*)(record + 1), context);
+        (*matches)++;
+      }
+    }
+    if(entries != NULL && store_add_entry(entries, count, capacity, record->time, record->address, offset) == false){
+      break;
+    }
+    offset = next;
+  }
+
+  return offset;
+}
+
+/**
+ * Seals a segment left unsealed by a crash. A torn record at the end is cut off first.
+ */
+static boolean store_recover(const char *path){
+  STORE_INDEX_ENTRY *entries = NULL;
+  uint32_t count = 0, capacity = 0;
+  STORE_FOOTER footer;
+  struct stat info;
+  boolean ok = false;
+  int fd = open(path, O_RDWR);
+
+  if(fd < 0){
+    return false;
+  }
+
+  if(fstat(fd, &info) == 0 && store_read_footer(fd, info.st_size, &footer)){
+    close(fd);
+    return true;
+  }
+
+  if(info.st_size >= (off_t)sizeof(STORE_FILE_HEADER)){
+    byte *map = (byte*)mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if(map != MAP_FAILED){
+      uint64_t end = store_scan(map, info.st_size, NULL, NULL, NULL, NULL, &entries, &count, &capacity);
+      munmap(map, info.st_size);
+      ok = ftruncate(fd, end) == 0 && store_seal(fd, end, entries, count);
+    }
+  }
+
+  free(entries);
+  close(fd);
+  if(ok){
+    fprintf(stderr, "%s: sealed %u records left by an earlier run\n", path, count);
+  }
+  return ok;
+}
+
+//highest segment number in the directory, 0 if there are none
+static uint32_t store_last_sequence(const char *directory){
+  DIR *dir = opendir(directory);
+  struct dirent *entry;
+  uint32_t last = 0;
+
+  if(dir == NULL){
+    return 0;
+  }
+  while((entry = readdir(dir)) != NULL){
+    unsigned int sequence;
+    char suffix[8];
+
+    if(sscanf(entry->d_name, "%10u.%7s", &sequence, suffix) == 2 && strcmp(suffix, "seg") == 0 && sequence > last){
+      last = sequence;
+    }
+  }
+  closedir(dir);
+  return last;
+}
+
+static boolean store_start_segment(TRAP_STORE *store){
+  STORE_FILE_HEADER header;
+  char path[STORE_PATH_LEN];
+
+  store->sequence++;
+  if(store_path(path, store->directory, store->sequence) == false){
+    fprintf(stderr, "%s: directory name too long\n", store->directory);
+    return false;
+  }
+  store->fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if(store->fd < 0){
+    perror(path);
+    return false;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, STORE_MAGIC, 8);
+  header.version = STORE_VERSION;
+  memcpy(store->buffer, &header, sizeof(header));
+  store->buffered = sizeof(header);
+  store->size = sizeof(header);
+  store->count = 0;
+  store->first_time = 0;
+  return true;
+}
+
+static boolean store_flush(TRAP_STORE *store){
+  boolean ok = store->fd < 0 || store_write(store->fd, store->buffer, store->buffered);
+
+  store->buffered = 0;
+  return ok;
+}
+
+static boolean store_finish_segment(TRAP_STORE *store){
+  boolean ok = store_flush(store) && store_seal(store->fd, store->size, store->entries, store->count);
+
+  close(store->fd);
+  store->fd = -1;
+  return ok;
+}
+
+/**
+ * Creates the directory if needed, seals whatever an earlier run left open and starts a new segment.
+ */
+static boolean store_open(TRAP_STORE *store, const char *directory){
+  char path[STORE_PATH_LEN];
+
+  memset(store, 0, sizeof(*store));
+  store->fd = -1;
+
+  //the segment names have to fit after it
+  if(store_path(path, directory, 0) == false){
+    fprintf(stderr, "%s: directory name too long\n", directory);
+    return false;
+  }
+  snprintf(store->directory, sizeof(store->directory), "%s", directory);
+
+  if(mkdir(directory, 0755) != 0 && errno != EEXIST){
+    perror(directory);
+    return false;
+  }
+
+  store->sequence = store_last_sequence(directory);
+  for(uint32_t i = store->sequence; i > 0 && i + 8 > store->sequence; i--){
+    //only the last few can be open, earlier runs seal theirs before starting the next one
+    if(store_path(path, directory, i) == true){
+      store_recover(path);
+    }
+  }
+
+  return store_start_segment(store);
+}
+
+/**
+ * One notification. Written when the buffer fills or store_flush() is called, sealing the segment when it is full.
+ */
+static boolean store_append(TRAP_STORE *store, uint64_t time, uint32_t address, uint16_t port, const byte *datagram, uint16_t size){
+  STORE_RECORD record;
+  uint32_t length = sizeof(record) + store_padded(size);
+
+  if(store->fd < 0){
+    return false;
+  }
+
+  if(store->count > 0 && (store->size + length > STORE_SEGMENT_LEN || time - store->first_time > STORE_SEGMENT_SPAN_MS)){
+    if(store_finish_segment(store) == false || store_start_segment(store) == false){
+      return false;
+    }
+  }
+
+  if(store_add_entry(&store->entries, &store->count, &store->capacity, time, address, store->size) == false){
+    return false;
+  }
+  if(store->count == 1){
+    store->first_time = time;
+  }
+
+  //records larger than the buffer go straight out
+  if(store->buffered + length > STORE_WRITE_BUFFER_LEN && store_flush(store) == false){
+    return false;
+  }
+
+  record.time = time;
+  record.address = address;
+  record.port = port;
+  record.size = size;
+
+  if(length > STORE_WRITE_BUFFER_LEN){
+    static const byte padding[8] = {0};
+    boolean ok = store_write(store->fd, &record, sizeof(record)) && store_write(store->fd, datagram, size)
+              && store_write(store->fd, padding, store_padded(size) - size);
+    store->size += length;
+    return ok;
+  }
+
+  memcpy(store->buffer + store->buffered, &record, sizeof(record));
+  memcpy(store->buffer + store->buffered + sizeof(record), datagram, size);
+  memset(store->buffer + store->buffered + sizeof(record) + size, 0, store_padded(size) - size);
+  store->buffered += length;
+  store->size += length;
+  return true;
+}
+
+static void store_close(TRAP_STORE *store){
+  if(store->fd >= 0){
+    store_finish_segment(store);
+  }
+  free(store->entries);
+  store->entries = NULL;
+}
+
+//first entry not before (address, time)
+static const STORE_INDEX_ENTRY *store_lower_bound(const STORE_INDEX_ENTRY *begin, const STORE_INDEX_ENTRY *end, uint32_t address, uint64_t time, boolean by_source){
+  while(begin < end){
+    const STORE_INDEX_ENTRY *middle = begin + (end - begin) / 2;
+    boolean before = by_source ? (middle->address < address || (middle->address == address && middle->time < time)) : middle->time < time;
+
+    if(before){
+      begin = middle + 1;
+    }else{
+      end = middle;
+    }
+  }
+  return begin;
+}
+
+/**
+ * Matching entries of one sealed segment, in time order.
+ *   Without a source range the time index is one contiguous run. With one, each source address in the range
+ *   is a run of the source index, found by binary search, and the runs are merged by sorting.
+ */
+static uint64_t store_query_sealed(const byte *map, const STORE_FOOTER *footer, const STORE_QUERY *query, STORE_VISITOR visit, void *context){
+  const STORE_INDEX_ENTRY *by_time = (const STORE_INDEX_ENTRY*)(map + footer->index_offset);
+  const STORE_INDEX_ENTRY *by_source = by_time + footer->count;
+  const STORE_INDEX_ENTRY *end = by_source + footer->count;
+  uint64_t matches = 0;
+
+  if(query->low == 0 && query->high == 0xFFFFFFFF){
+    for(const STORE_INDEX_ENTRY *e = store_lower_bound(by_time, by_source, 0, query->from, false); e < by_source && e->time <= query->to; e++){
+      const STORE_RECORD *record = (const STORE_RECORD*)(map + e->offset);
+      visit(record, (const byte*)(record + 1), context);
+      matches++;
+    }
+    return matches;
+  }
+
+  STORE_INDEX_ENTRY *found = NULL;
+  uint32_t count = 0, capacity = 0;
+  const STORE_INDEX_ENTRY *e = store_lower_bound(by_source, end, query->low, query->from, true);
+
+  while(e < end && e->address <= query->high){
+    if(e->time > query->to){
+      //rest of this address is too late, continue with the next one
+      if(e->address == 0xFFFFFFFF){
+        break;
+      }
+      e = store_lower_bound(e, end, e->address + 1, query->from, true);
+      continue;
+    }
+    if(e->time < query->from){
+      e = store_lower_bound(e, end, e->address, query->from, true);
+      continue;
+    }
+    if(store_add_entry(&found, &count, &capacity, e->time, htonl(e->address), e->offset) == false){
+      break;
+    }
+    e++;
+  }
+
+  qsort(found, count, sizeof(STORE_INDEX_ENTRY), store_by_time);
+  for(uint32_t i = 0; i < count; i++){
+    const STORE_RECORD *record = (const STORE_RECORD*)(map + found[i].offset);
+    visit(record, (const byte*)(record + 1), context);
+  }
+  free(found);
+  return count;
+}
+
+static int store_segment_name(const struct dirent *entry){
+  unsigned int sequence;
+  char suffix[8];
+
+  return sscanf(entry->d_name, "%10u.%7s", &sequence, suffix) == 2 && strcmp(suffix, "seg") == 0;
+}
+
+/**
+ * Visits every stored notification that matches, returns how many there were.
+ *   Sealed segments outside the time range are skipped after reading their footer.
+ */
+static uint64_t store_query(const char *directory, const STORE_QUERY *query, STORE_VISITOR visit, void *context){
+  struct dirent **names;
+  uint64_t matches = 0;
+  int count = scandir(directory, &names, store_segment_name, alphasort);
+
+  if(count < 0){
+    perror(directory);
+    return 0;
+  }
+
+  for(int i = 0; i < count; i++){
+    char path[STORE_PATH_LEN];
+    STORE_FOOTER footer;
+    struct stat info;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", directory, names[i]->d_name);
+    free(names[i]);
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0 || fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(STORE_FILE_HEADER)){
+      if(fd >= 0){
+        close(fd);
+      }
+      continue;
+    }
+
+    boolean sealed = store_read_footer(fd, info.st_size, &footer);
+    if(sealed && (footer.count == 0 || footer.last_time < query->from || footer.first_time > query->to)){
+      close(fd);
+      continue;
+    }
+
+    byte *map = (byte*)mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+      continue;
+    }
+
+    if(memcmp(map, STORE_MAGIC, 8) == 0){
+      if(sealed){
+        matches += store_query_sealed(map, &footer, query, visit, context);
+      }else{
+        store_scan(map, info.st_size, query, visit, context, &matches, NULL, NULL, NULL);
+      }
+    }
+    munmap(map, info.st_size);
+  }
+
+  free(names);
+  return matches;
+}
+
+#endif
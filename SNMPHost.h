@@ -0,0 +1,51 @@
+/*
+  SNMPHost.h - What ArduinoSNMP.h needs from the Arduino core, for host builds with -DSNMP_HOST.
+  Copyright (C) 2013 Rex Park <rex.park@me.com>
+  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+*/
+
+#ifndef SNMPHost_h
+#define SNMPHost_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+//milliseconds from a monotonic clock, 32-bit like on the boards so rollover behaves the same
+inline unsigned long millis(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)(now.tv_sec * 1000ULL + now.tv_nsec / 1000000);
+}
+
+/**
+ * IPv4 address with the parts of Arduino's IPAddress that the value types use.
+ *
+ * Original Author: Rex Park
+ */
+class IPAddress {
+public:
+  IPAddress(){ memset(_address, 0, 4); }
+  IPAddress(byte a, byte b, byte c, byte d){ _address[0] = a; _address[1] = b; _address[2] = c; _address[3] = d; }
+  IPAddress(uint32_t address){ memcpy(_address, &address, 4); }
+  
+  byte operator[](int index) const { return _address[index]; }
+  byte &operator[](int index){ return _address[index]; }
+  operator uint32_t() const { uint32_t address; memcpy(&address, _address, 4); return address; }
+  bool operator==(const IPAddress &other) const { return memcmp(_address, other._address, 4) == 0; }
+  
+private:
+  byte _address[4];
+};
+
+#endif